@@ -69,8 +69,8 @@ StageProcedure::SignatureIO FragmentShader::OutputSignature() const {
 
 
 void FragmentShader::operator()(RuntimeIO * io) {
-    static Fragment frag;
-    static Vertex  v[3];
+    Fragment frag;
+    Vertex  v[3];
 
     io->ReadNext<Fragment>(&frag);
 
@@ -80,7 +80,7 @@ void FragmentShader::operator()(RuntimeIO * io) {
     io->ReadNext<Vertex>(v+2);    
 
 
-    static uint8_t color[4];
+    uint8_t color[4];
     color[0] = UINT8_MAX * (frag.bias0*v[0].r + frag.bias1*v[1].r + frag.bias2*v[2].r); 
     color[1] = UINT8_MAX * (frag.bias0*v[0].g + frag.bias1*v[1].g + frag.bias2*v[2].g); 
     color[2] = UINT8_MAX * (frag.bias0*v[0].b + frag.bias1*v[1].b + frag.bias2*v[2].b); 
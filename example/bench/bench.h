@@ -0,0 +1,51 @@
+/// Helpers shared by the SoftRaster benchmarks
+///
+/// Each benchmark is a small program that prints its own results.
+/// Times are the fastest of several runs, since the slower runs 
+/// mostly measure whatever else the machine was doing.
+
+#include <SoftRaster/SoftRaster.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+
+// Returns the current time in seconds from an arbitrary start
+inline double Seconds() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Returns the fastest time of runs calls to fn, in seconds
+template<typename Fn>
+double Fastest(int runs, Fn fn) {
+    double best = 1e30;
+    for(int i = 0; i < runs; ++i) {
+        double start = Seconds();
+        fn();
+        best = std::min(best, Seconds() - start);
+    }
+    return best;
+}
+
+
+
+// Passes each vertex on unchanged
+class PassVertices : public SoftRaster::StageProcedure {
+  public:
+    SignatureIO InputSignature() const {
+        SignatureIO input;
+        input.AddSlot(SoftRaster::DataType::UserVertex);
+        return input;
+    }
+
+    SignatureIO OutputSignature() const {
+        SignatureIO output;
+        output.AddSlot(SoftRaster::DataType::UserVertex);
+        return output;
+    }
+
+    void operator()(SoftRaster::RuntimeIO * io) {
+        memcpy(io->GetWritePointer(), io->GetReadPointer(), io->GetReadSize());
+        io->Commit();
+    }
+};
@@ -0,0 +1,92 @@
+/// Benchmark: triangle rasterization by method
+///
+/// Rasterizes three scenes with each RasterMethod, through PrimitiveRasterizer,
+/// so that only fragment generation and depth testing are timed:
+///
+///  - 20 full-screen quads drawn back to front, where every pixel passes
+///    and the time mostly goes to writing out fragments,
+///  - the same quads drawn front to back, where all but the first are hidden
+///    and the time goes to finding coverage and depth testing it,
+///  - 4000 slivers, each crossing much of the screen but covering little of
+///    its bounds, so that most blocks of the bounds are skipped whole.
+
+#include "bench.h"
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+using namespace SoftRaster;
+
+
+static const int NumFrames = 5;
+static const int NumQuads  = 20;
+
+static Vector3 Point(float x, float y, float z) {
+    Vector3 v;
+    v.x = x; v.y = y; v.z = z;
+    return v;
+}
+
+static float Random() {
+    return (rand() % 2000) / 1000.f - 1.f;
+}
+
+// Full-screen quads from depth first to last. Greater depths are nearer.
+static std::vector<Vector3> Quads(float first, float last) {
+    std::vector<Vector3> out;
+    for(int i = 0; i < NumQuads; ++i) {
+        float z = first + (last - first) * i / (NumQuads - 1);
+        out.push_back(Point(-1, -1, z)); out.push_back(Point(1, -1, z)); out.push_back(Point(-1, 1, z));
+        out.push_back(Point( 1, -1, z)); out.push_back(Point(1,  1, z)); out.push_back(Point(-1, 1, z));
+    }
+    return out;
+}
+
+static std::vector<Vector3> Slivers() {
+    std::vector<Vector3> out;
+    srand(9);
+    for(int i = 0; i < 4000; ++i) {
+        float x = Random(), y = Random(), z = (rand() % 1000) / 1000.f;
+        out.push_back(Point(x, y, z));
+        out.push_back(Point(Random(), Random(), z));
+        out.push_back(Point(x + .004f, y + .006f, z));
+    }
+    return out;
+}
+
+
+int main() {
+    Texture framebuffer(640, 480);
+    std::vector<Fragment> fragments;
+    fragments.reserve(1 << 20);
+
+    const char * scenes[] = {"quads, back to front", "quads, front to back", "slivers"};
+    std::vector<Vector3> vertices[] = {Quads(-.9f, .9f), Quads(.9f, -.9f), Slivers()};
+
+    const char * names[] = {"barycentric", "edge functions"};
+    RasterMethod methods[] = {RasterMethod::Barycentric, RasterMethod::EdgeFunctions};
+    printf("%d frames at 640x480:\n", NumFrames);
+    for(int s = 0; s < 3; ++s) {
+        const std::vector<Vector3> & scene = vertices[s];
+        for(int m = 0; m < 2; ++m) {
+            RasterizerSettings settings;
+            settings.method = methods[m];
+            PrimitiveRasterizer rasterizer(settings);
+
+            size_t count = 0;
+            double time = Fastest(3, [&]() {
+                count = 0;
+                for(int frame = 0; frame < NumFrames; ++frame) {
+                    rasterizer.Begin(&framebuffer);
+                    for(size_t i = 0; i < scene.size(); i += 3) {
+                        const Vector3 * v[] = {&scene[i], &scene[i+1], &scene[i+2]};
+                        fragments.clear();
+                        rasterizer.Rasterize(v, fragments);
+                        count += fragments.size();
+                    }
+                }
+            });
+            printf("  %-21s %-15s %.3f s, %zu fragments\n", scenes[s], names[m], time, count);
+        }
+    }
+    return 0;
+}
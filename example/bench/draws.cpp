@@ -0,0 +1,89 @@
+/// Benchmark: fixed cost of each draw
+///
+/// Renders the same tiny triangle many times, one draw each, so that
+/// the time is mostly what a draw costs before and after its few
+/// iterations: setting up each stage's inputs and outputs, running
+/// the stages, and finishing the draw.
+///
+/// For comparison, the draws are timed again while also resolving each 
+/// stage's slot layout from its signatures on every draw, which draws
+/// did before Pipeline::Compile() resolved them once.
+
+#include "bench.h"
+#include <cstdio>
+using namespace SoftRaster;
+
+
+struct Vertex : public Vector3 {
+    Vertex() {}
+    Vertex(float x_, float y_) { x = x_; y = y_; z = 0.f; }
+    float r, g, b;
+};
+
+// Writes a white pixel for each fragment
+class WhiteFragments : public StageProcedure {
+  public:
+    SignatureIO InputSignature() const {
+        SignatureIO input;
+        input.AddSlot(DataType::Fragment);
+        input.AddSlot(DataType::UserVertex);
+        input.AddSlot(DataType::UserVertex);
+        input.AddSlot(DataType::UserVertex);
+        return input;
+    }
+
+    SignatureIO OutputSignature() const {
+        return SignatureIO();
+    }
+
+    void operator()(RuntimeIO * io) {
+        Fragment frag;
+        io->ReadNext<Fragment>(&frag);
+        uint8_t white[] = {255, 255, 255, 255};
+        io->GetFramebuffer()->PutPixel(frag.x, frag.y, white);
+    }
+};
+
+
+static const int NumDraws = 200000;
+
+int main() {
+    PassVertices   vertices;
+    WhiteFragments fragments;
+    StageProcedure * rasterizer = CreateRasterizer(Polygon::Triangles);
+
+    Pipeline pipeline;
+    pipeline.PushExecutionStage(&vertices);
+    pipeline.PushExecutionStage(rasterizer);
+    pipeline.PushExecutionStage(&fragments);
+    Pipeline::Program * program = pipeline.Compile();
+
+    Texture framebuffer(64, 64);
+    Context context(&framebuffer);
+    context.UseProgram(program);
+
+    Vertex triangle[] = {
+        Vertex(-.05f, -.05f), Vertex(.05f, -.05f), Vertex(0.f, .05f)
+    };
+    StageProcedure * stages[] = {&vertices, rasterizer, &fragments};
+    StageLayout layouts[3];
+    for(int resolve = 1; resolve >= 0; --resolve) {
+        double time = Fastest(5, [&]() {
+            for(int i = 0; i < NumDraws; ++i) {
+                if (resolve) {
+                    for(int n = 0; n < 3; ++n) {
+                        layouts[n].Build(stages[n]);
+                        layouts[n].Patch(sizeof(Vertex));
+                    }
+                }
+                context.RenderVertices<Vertex>(triangle, 3);
+            }
+        });
+        printf("3-vertex draws through 3 stages, %s: %.3f us/draw\n", 
+            resolve ? "layouts resolved per draw" : "layouts resolved by Compile()", time / NumDraws * 1e6);
+    }
+
+    delete program;
+    delete rasterizer;
+    return 0;
+}
@@ -0,0 +1,83 @@
+/// Benchmark: reading pixels by layout
+///
+/// Reads pixels of a 4096x4096 texture with GetPixel() along the paths
+/// a sampler takes: a 1024x1024 window rotated 30 degrees, the same
+/// window minified 2x, down columns, and at random. Each path is read
+/// from Linear storage and then from Tiled storage. The time to convert
+/// between the layouts is reported too.
+
+#include "bench.h"
+#include <cmath>
+#include <cstdio>
+#include <vector>
+using namespace SoftRaster;
+
+
+static const int Size   = 4096;
+static const int Window = 1024;
+
+static uint32_t sum; // keeps the reads from being optimized away
+
+// Reads a Window-by-Window grid rotated 30 degrees about the center, scale pixels apart
+static void ReadRotated(const Texture & texture, float scale) {
+    float cs = std::cos(.5236f)*scale, sn = std::sin(.5236f)*scale;
+    uint8_t pixel[4];
+    for(int y = 0; y < Window; ++y) {
+        float u = Size/2 - (Window/2)*cs + (y - Window/2)*sn;
+        float v = Size/2 - (Window/2)*sn - (y - Window/2)*cs;
+        for(int x = 0; x < Window; ++x) {
+            texture.GetPixel(u, v, pixel);
+            sum += pixel[0];
+            u += cs;
+            v += sn;
+        }
+    }
+}
+
+// Reads every third column from top to bottom
+static void ReadColumns(const Texture & texture) {
+    uint8_t pixel[4];
+    for(int x = 0; x < Size; x += 3)
+        for(int y = 0; y < Size; ++y) {
+            texture.GetPixel(x, y, pixel);
+            sum += pixel[0];
+        }
+}
+
+// Reads Window*Window pixels at random
+static void ReadRandom(const Texture & texture) {
+    uint8_t pixel[4];
+    uint32_t seed = 7;
+    for(int i = 0; i < Window*Window; ++i) {
+        seed = seed*1664525u + 1013904223u;
+        texture.GetPixel((seed >> 8) % Size, (seed >> 20) % Size, pixel);
+        sum += pixel[0];
+    }
+}
+
+
+int main() {
+    Texture texture(Size, Size);
+    uint8_t * data = texture.GetData();
+    for(size_t i = 0; i < (size_t)Size*Size*4; ++i) data[i] = i*31;
+
+    const char * names[] = {"linear", "tiled"};
+    Texture::Layout layouts[] = {Texture::Layout::Linear, Texture::Layout::Tiled};
+    for(int l = 0; l < 2; ++l) {
+        texture.SetLayout(layouts[l]);
+        double window  = Window*Window / 1e6;
+        double columns = (Size/3 + 1) * (double)Size / 1e6;
+        printf("%-6s GetPixel Mpix/s: rotated %.0f, rotated and minified %.0f, columns %.0f, random %.0f\n", names[l],
+            window  / Fastest(3, [&]() { ReadRotated(texture, 1.f); }),
+            window  / Fastest(3, [&]() { ReadRotated(texture, 2.f); }),
+            columns / Fastest(3, [&]() { ReadColumns(texture); }),
+            window  / Fastest(3, [&]() { ReadRandom(texture); }));
+    }
+
+    double convert = Fastest(3, [&]() {
+        texture.SetLayout(Texture::Layout::Linear);
+        texture.SetLayout(Texture::Layout::Tiled);
+    }) / 2;
+    printf("converting %dx%d between layouts: %.1f ms (%u)\n", Size, Size, convert * 1e3, sum & 1);
+    return 0;
+}
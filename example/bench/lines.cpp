@@ -0,0 +1,106 @@
+/// Benchmark: points and lines
+///
+/// Renders many single-pixel points, with and without depth testing,
+/// then many short lines, each as one draw through a pass-through vertex
+/// stage. Fragments carry only their primitive and are written by a stage
+/// that marks their pixel, so the time is mostly spent rasterizing.
+
+#include "bench.h"
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+using namespace SoftRaster;
+
+
+struct Vertex : public Vector3 {
+    Vertex() {}
+    Vertex(float x_, float y_, float z_) { x = x_; y = y_; z = z_; }
+};
+
+// Marks the pixel of each fragment, a batch at a time
+class MarkFragments : public StageProcedure {
+  public:
+    SignatureIO InputSignature() const {
+        SignatureIO input;
+        input.AddSlot(DataType::Fragment);
+        input.AddSlot(DataType::PrimitiveID);
+        return input;
+    }
+
+    SignatureIO OutputSignature() const {
+        return SignatureIO();
+    }
+
+    void Batch(RuntimeIO * io, uint32_t count) {
+        Texture * framebuffer = io->GetFramebuffer();
+        uint8_t * data = framebuffer->GetData();
+        for(uint32_t i = 0; i < count; ++i) {
+            const Fragment * frag = (const Fragment*)io->GetReadPointer(io->GetCurrentIteration() + i);
+            data[4*(frag->x + frag->y*framebuffer->Width())] = 255;
+        }
+    }
+
+    void operator()(RuntimeIO * io) {
+        Batch(io, 1);
+    }
+};
+
+
+static const int NumPoints = 2000000;
+static const int NumLines  = 200000;
+
+static float Random() {
+    return (rand() % 20000) / 10000.f - 1.f;
+}
+
+// Returns the time to draw the vertices as the given primitives, in seconds
+static double Draw(std::vector<Vertex> & vertices, const RasterizerSettings & settings) {
+    PassVertices   pass;
+    MarkFragments  mark;
+    StageProcedure * rasterizer = CreateRasterizer(settings);
+
+    Pipeline pipeline;
+    pipeline.PushExecutionStage(&pass);
+    pipeline.PushExecutionStage(rasterizer);
+    pipeline.PushExecutionStage(&mark);
+    Pipeline::Program * program = pipeline.Compile();
+
+    Texture framebuffer(1024, 768);
+    Context context(&framebuffer);
+    context.UseProgram(program);
+    double time = Fastest(3, [&]() {
+        context.RenderVertices<Vertex>(vertices.data(), vertices.size());
+    });
+
+    delete program;
+    delete rasterizer;
+    return time;
+}
+
+
+int main() {
+    srand(5);
+    std::vector<Vertex> points;
+    for(int i = 0; i < NumPoints; ++i) {
+        points.push_back(Vertex(Random(), Random(), (rand() % 1000) / 1000.f));
+    }
+
+    // each line spans about 10 by 4 pixels
+    std::vector<Vertex> lines;
+    for(int i = 0; i < NumLines; ++i) {
+        lines.push_back(points[i]);
+        lines.push_back(Vertex(points[i].x + .02f, points[i].y + .01f, 0.f));
+    }
+
+    RasterizerSettings settings(Polygon::Points, DepthBuffering::None);
+    settings.format = FragmentFormat::PrimitiveID;
+    printf("points, no depth:   %.1f M/s\n", NumPoints / Draw(points, settings) / 1e6);
+
+    settings.depth = DepthBuffering::BytePrecision;
+    printf("points, byte depth: %.1f M/s\n", NumPoints / Draw(points, settings) / 1e6);
+
+    settings = RasterizerSettings(Polygon::Lines, DepthBuffering::None);
+    settings.format = FragmentFormat::PrimitiveID;
+    printf("short lines:        %.1f M/s\n", NumLines / Draw(lines, settings) / 1e6);
+    return 0;
+}
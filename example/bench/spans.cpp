@@ -0,0 +1,59 @@
+/// Benchmark: blending pixels into a texture
+///
+/// Blends a row of pixels into every row of a 1024x1024 texture, one
+/// pixel at a time with PutPixel(), then a row at a time with PutSpan(),
+/// with and without a mask, and reports how many pixels are blended
+/// each second.
+
+#include "bench.h"
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+using namespace SoftRaster;
+
+
+static const int Size    = 1024;
+static const int Repeats = 20;
+
+static std::vector<uint8_t> row(Size*4);
+static std::vector<uint8_t> mask(Size);
+
+// Returns the millions of pixels blended per second by fn, which blends the whole texture
+template<typename Fn>
+static double Rate(Fn fn) {
+    return Size * Size * (double)Repeats / Fastest(3, [&]() {
+        for(int i = 0; i < Repeats; ++i) fn();
+    }) / 1e6;
+}
+
+
+int main() {
+    srand(1);
+    for(size_t i = 0; i < row.size();  ++i) row[i]  = rand();
+    for(size_t i = 0; i < mask.size(); ++i) mask[i] = rand() & 1;
+
+    Texture texture(Size, Size);
+    uint8_t clear[] = {0, 0, 0, 0};
+    texture.Clear(clear);
+
+    const char * names[] = {"alpha", "additive"};
+    Texture::ColorAddRule rules[] = {Texture::ColorAddRule::Alpha, Texture::ColorAddRule::Additive};
+    for(int r = 0; r < 2; ++r) {
+        texture.SetBlendRule(rules[r]);
+        double pixels = Rate([&]() {
+            for(int y = 0; y < Size; ++y)
+                for(int x = 0; x < Size; ++x)
+                    texture.PutPixel(x, y, &row[4*x]);
+        });
+        double spans = Rate([&]() {
+            for(int y = 0; y < Size; ++y)
+                texture.PutSpan(0, y, Size, &row[0]);
+        });
+        double masked = Rate([&]() {
+            for(int y = 0; y < Size; ++y)
+                texture.PutSpan(0, y, Size, &row[0], &mask[0]);
+        });
+        printf("%-8s Mpix/s: PutPixel %.0f, PutSpan %.0f, masked PutSpan %.0f\n", names[r], pixels, spans, masked);
+    }
+    return 0;
+}
@@ -0,0 +1,140 @@
+/// Benchmark: scaling across workers
+///
+/// Renders a frame of many small, shaded triangles with 1, 2, 4 and 8 workers
+/// (see Pipeline::Program::SetWorkerCount()), through a vertex stage that
+/// does some work per vertex, a rasterizer that bins the screen, and a fragment
+/// stage that blends each pixel. Every stage of the frame can then run on
+/// all workers, so the time should fall close to linearly up to the number
+/// of cores, which is printed alongside.
+
+#include "bench.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+using namespace SoftRaster;
+
+
+struct Vertex : public Vector3 {
+    float r, g, b;
+};
+
+// Turns each vertex about the center a few times over
+class SpinVertices : public StageProcedure {
+  public:
+    SignatureIO InputSignature() const {
+        SignatureIO input;
+        input.AddSlot(DataType::UserVertex);
+        return input;
+    }
+
+    SignatureIO OutputSignature() const {
+        SignatureIO output;
+        output.AddSlot(DataType::UserVertex);
+        return output;
+    }
+
+    void operator()(RuntimeIO * io) {
+        Vertex v;
+        io->ReadNext<Vertex>(&v);
+        for(int i = 0; i < 16; ++i) {
+            float x = v.x*std::cos(.3926991f) - v.y*std::sin(.3926991f);
+            float y = v.x*std::sin(.3926991f) + v.y*std::cos(.3926991f);
+            v.x = x;
+            v.y = y;
+        }
+        io->WriteNext<Vertex>(&v);
+        io->Commit();
+    }
+};
+
+// Blends the interpolated color of each fragment
+class ShadeFragments : public StageProcedure {
+  public:
+    SignatureIO InputSignature() const {
+        SignatureIO input;
+        input.AddSlot(DataType::Fragment);
+        input.AddSlot(DataType::UserVertex);
+        input.AddSlot(DataType::UserVertex);
+        input.AddSlot(DataType::UserVertex);
+        return input;
+    }
+
+    SignatureIO OutputSignature() const {
+        return SignatureIO();
+    }
+
+    void operator()(RuntimeIO * io) {
+        Fragment frag;
+        Vertex v[3];
+        io->ReadNext<Fragment>(&frag);
+        io->ReadNext<Vertex>(v);
+        io->ReadNext<Vertex>(v+1);
+        io->ReadNext<Vertex>(v+2);
+        uint8_t pixel[] = {
+            (uint8_t)(255*(frag.bias0*v[0].r + frag.bias1*v[1].r + frag.bias2*v[2].r)),
+            (uint8_t)(255*(frag.bias0*v[0].g + frag.bias1*v[1].g + frag.bias2*v[2].g)),
+            (uint8_t)(255*(frag.bias0*v[0].b + frag.bias1*v[1].b + frag.bias2*v[2].b)),
+            128
+        };
+        io->GetFramebuffer()->PutPixel(frag.x, frag.y, pixel);
+    }
+};
+
+
+static const int NumTriangles = 100000;
+
+static float Random() {
+    return (rand() % 2000) / 1000.f - 1.f;
+}
+
+
+int main() {
+    srand(3);
+    std::vector<Vertex> vertices;
+    for(int i = 0; i < NumTriangles; ++i) {
+        float x = Random(), y = Random();
+        for(int n = 0; n < 3; ++n) {
+            Vertex v;
+            v.x = x + (n == 1 ? .03f : 0.f);
+            v.y = y + (n == 2 ? .04f : 0.f);
+            v.z = Random();
+            v.r = (rand() % 256) / 255.f;
+            v.g = (rand() % 256) / 255.f;
+            v.b = (rand() % 256) / 255.f;
+            vertices.push_back(v);
+        }
+    }
+
+    SpinVertices   spin;
+    ShadeFragments shade;
+    RasterizerSettings settings(Polygon::Triangles, DepthBuffering::None);
+    settings.binSize = 32;
+    StageProcedure * rasterizer = CreateRasterizer(settings);
+
+    Pipeline pipeline;
+    pipeline.PushExecutionStage(&spin);
+    pipeline.PushExecutionStage(rasterizer);
+    pipeline.PushExecutionStage(&shade);
+    Pipeline::Program * program = pipeline.Compile();
+
+    Texture framebuffer(640, 480);
+    Context context(&framebuffer);
+    context.UseProgram(program);
+
+    printf("%d triangles at 640x480, %u cores:\n", NumTriangles, std::thread::hardware_concurrency());
+    double single = 0.;
+    for(uint32_t workers = 1; workers <= 8; workers *= 2) {
+        program->SetWorkerCount(workers);
+        double time = Fastest(3, [&]() {
+            context.RenderVertices<Vertex>(vertices.data(), vertices.size());
+        });
+        if (workers == 1) single = time;
+        printf("  %u worker(s): %.3f s, %.2fx\n", workers, time, single / time);
+    }
+
+    delete program;
+    delete rasterizer;
+    return 0;
+}
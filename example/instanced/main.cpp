@@ -0,0 +1,171 @@
+/// Check of instanced rendering with SoftRaster
+///
+/// Renders a mesh many times with Context::RenderInstanced(), through a
+/// first stage that runs its iterations in one StageProcedure::Batch() call,
+/// and checks that the framebuffer and depth buffer match, byte for byte,
+/// drawing each instance on its own. This is done with and without streaming
+/// (see Pipeline::Program::SetChunkSize()) and with 1 and 3 workers.
+/// Exits with 0 if all match.
+
+
+#include "../base/basics.h"
+#include <cstring>
+#include <iostream>
+#include <vector>
+using namespace SoftRaster;
+
+
+static const int NumInstances = 300;
+
+
+// Where an instance of the mesh goes, and its color
+struct Instance {
+    float dx, dy, dz;
+    float r;
+};
+
+
+// Moves each vertex by its instance, if there is one
+class InstanceShader : public StageProcedure {
+  public:
+    SignatureIO InputSignature() const {
+        SignatureIO input;
+        input.AddSlot(DataType::UserVertex);
+        return input;
+    }
+
+    SignatureIO OutputSignature() const {
+        SignatureIO output;
+        output.AddSlot(DataType::UserVertex);
+        return output;
+    }
+
+    void operator()(RuntimeIO * io) {
+        Vertex v;
+        io->ReadNext<Vertex>(&v);
+        Move(&v, (const Instance*)io->GetInstanceData());
+        io->WriteNext<Vertex>(&v);
+        io->Commit();
+    }
+
+    // The same vertices are read again for each instance, so inputs
+    // are found by iteration rather than walked one after another.
+    void Batch(RuntimeIO * io, uint32_t count) {
+        uint32_t first = io->GetCurrentIteration();
+        uint8_t * out = io->GetWriteSpan(count);
+        for(uint32_t n = 0; n < count; ++n) {
+            Vertex * v = (Vertex*)(out + n*io->GetWriteSize());
+            memcpy(v, io->GetReadPointer(first + n), sizeof(Vertex));
+            Move(v, (const Instance*)io->GetInstanceData(io->GetInstance(first + n)));
+        }
+        io->CommitSpan(count);
+    }
+
+    static void Move(Vertex * v, const Instance * instance) {
+        if (!instance) return;
+        v->x += instance->dx;
+        v->y += instance->dy;
+        v->z += instance->dz;
+        v->r  = instance->r;
+    }
+};
+
+
+// The output of one render
+struct Result {
+    std::vector<uint8_t> pixels;
+    std::vector<float>   depths;
+};
+
+static Result Render(Pipeline * pipeline, uint32_t chunkSize, uint32_t workers, bool instanced,
+                     std::vector<Vertex> & mesh, const std::vector<Instance> & instances) {
+    Pipeline::Program * program = pipeline->Compile();
+    program->SetChunkSize(chunkSize);
+    program->SetWorkerCount(workers);
+
+    Texture framebuffer(160, 120);
+    DepthBuffer depth(DepthBuffering::FloatPrecision);
+    Context context(&framebuffer);
+    context.SetDepthBuffer(&depth);
+    context.UseProgram(program);
+
+    uint8_t clear[] = {0, 0, 0, 0};
+    framebuffer.Clear(clear);
+    depth.Clear();
+    if (instanced) {
+        context.RenderInstanced(&mesh[0], mesh.size(), &instances[0], instances.size());
+    } else {
+        std::vector<Vertex> moved(mesh);
+        for(uint32_t i = 0; i < instances.size(); ++i) {
+            for(uint32_t n = 0; n < mesh.size(); ++n) {
+                moved[n] = mesh[n];
+                InstanceShader::Move(&moved[n], &instances[i]);
+            }
+            context.RenderVertices<Vertex>(&moved[0], moved.size());
+        }
+    }
+
+    Result result;
+    uint8_t * data = framebuffer.GetData();
+    result.pixels.assign(data, data + framebuffer.Width()*framebuffer.Height()*4);
+    for(uint16_t y = 0; y < framebuffer.Height(); ++y) {
+        for(uint16_t x = 0; x < framebuffer.Width(); ++x) {
+            result.depths.push_back(depth.GetDepth(x, y));
+        }
+    }
+    delete program;
+    return result;
+}
+
+static bool Matches(const Result & a, const Result & b) {
+    return a.pixels == b.pixels &&
+           a.depths.size() == b.depths.size() &&
+           !memcmp(&a.depths[0], &b.depths[0], a.depths.size()*sizeof(float));
+}
+
+
+int main() {
+    // a quad of two triangles, scattered about the screen at different depths
+    float s = .08f;
+    std::vector<Vertex> mesh;
+    mesh.push_back(Vertex(-s, -s, 0, 0, 0, 1, 1));
+    mesh.push_back(Vertex( s, -s, 0, 0, 1, 1, 1));
+    mesh.push_back(Vertex(-s,  s, 0, 0, 0, 0, 1));
+    mesh.push_back(Vertex(-s,  s, 0, 0, 0, 0, 1));
+    mesh.push_back(Vertex( s, -s, 0, 0, 1, 1, 1));
+    mesh.push_back(Vertex( s,  s, 0, 0, 1, 0, 1));
+
+    std::vector<Instance> instances;
+    for(int i = 0; i < NumInstances; ++i) {
+        Instance instance;
+        instance.dx = (i*37 % 180) / 100.f - .9f;
+        instance.dy = (i*53 % 180) / 100.f - .9f;
+        instance.dz = (i*71 % 100) / 100.f - .5f;
+        instance.r  = (i % 9) / 8.f;
+        instances.push_back(instance);
+    }
+
+    InstanceShader vShader;
+    FragmentShader fShader;
+    StageProcedure * rasterizer = CreateRasterizer(RasterizerSettings(Polygon::Triangles));
+    Pipeline pipeline;
+    pipeline.PushExecutionStage(&vShader);
+    pipeline.PushExecutionStage(rasterizer);
+    pipeline.PushExecutionStage(&fShader);
+
+    // chunks of 64 do not line up with the 6 vertices of an instance
+    int mismatches = 0;
+    Result expected = Render(&pipeline, 0, 1, false, mesh, instances);
+    for(uint32_t chunkSize = 0; chunkSize <= 64; chunkSize += 64) {
+        for(uint32_t workers = 1; workers <= 3; workers += 2) {
+            if (!Matches(expected, Render(&pipeline, chunkSize, workers, true, mesh, instances))) {
+                std::cout << "chunk size " << chunkSize << " with " << workers << " worker(s) differs from drawing each instance" << std::endl;
+                mismatches++;
+            }
+        }
+    }
+    delete rasterizer;
+
+    std::cout << (mismatches ? "FAILED" : "OK") << ": " << NumInstances << " instances checked against drawing each instance, streamed and not" << std::endl;
+    return mismatches ? 1 : 0;
+}
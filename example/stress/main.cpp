@@ -0,0 +1,138 @@
+/// Stress test of concurrent rendering with SoftRaster
+///
+/// Several threads each render with their own Program, compiled from one
+/// shared Pipeline, into their own framebuffer and depth buffer. Every
+/// framebuffer and depth buffer must match, byte for byte, what the same
+/// Program gives when rendered alone. Exits with 0 if all match.
+
+
+#include "../base/basics.h"
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+using namespace SoftRaster;
+
+
+// Number of jobs rendered at once, and how many times each renders
+static const int NumJobs   = 6;
+static const int NumFrames = 20;
+
+
+// The output of one render
+struct Result {
+    std::vector<uint8_t> pixels;
+    std::vector<float>   depths;
+};
+
+
+// Overlapping triangles at different depths, so the result depends on depth testing,
+// with a few more for each job so that jobs differ from one another.
+static std::vector<Vertex> Scene(int job) {
+    std::vector<Vertex> out;
+    for(int i = 0; i < 12 + job*3; ++i) {
+        float z = -.9f + (i % 12) * .15f;
+        float o = (i % 7) * .06f - .2f;
+        float c = (i % 5) / 4.f;
+        out.push_back(Vertex(-.9f + o, -.8f,     z,   c,   1.f, 0.f, 1.f));
+        out.push_back(Vertex( .9f,     -.7f + o, z,   0.f, c,   1.f, 1.f));
+        out.push_back(Vertex(-.2f - o,  .9f - o, -z,  1.f, 0.f, c,   1.f));
+    }
+    return out;
+}
+
+
+// Renders the job's scene NumFrames times, keeping what the last frame left
+static void Render(Pipeline * pipeline, int job, uint32_t workers, Result * result) {
+    Pipeline::Program * program = pipeline->Compile();
+    program->SetWorkerCount(workers);
+
+    Texture framebuffer(96 + job*7, 64 + job*5);
+    DepthBuffer depth(job % 2 ? DepthBuffering::FloatPrecision : DepthBuffering::ShortPrecision);
+    Context context(&framebuffer);
+    context.SetDepthBuffer(&depth);
+    context.UseProgram(program);
+
+    std::vector<Vertex> scene = Scene(job);
+    uint8_t clear[] = {0, 0, 0, 0};
+    for(int i = 0; i < NumFrames; ++i) {
+        framebuffer.Clear(clear);
+        depth.Clear();
+        context.RenderVertices<Vertex>(&scene[0], scene.size());
+    }
+
+    uint8_t * data = framebuffer.GetData();
+    result->pixels.assign(data, data + framebuffer.Width()*framebuffer.Height()*4);
+    result->depths.clear();
+    for(uint16_t y = 0; y < framebuffer.Height(); ++y) {
+        for(uint16_t x = 0; x < framebuffer.Width(); ++x) {
+            result->depths.push_back(depth.GetDepth(x, y));
+        }
+    }
+    delete program;
+}
+
+static bool Matches(const Result & a, const Result & b) {
+    return a.pixels == b.pixels &&
+           a.depths.size() == b.depths.size() &&
+           !memcmp(&a.depths[0], &b.depths[0], a.depths.size()*sizeof(float));
+}
+
+
+
+// Renders every job serially, then all at once with 1 and 3 workers each,
+// and returns how many of the concurrent results differ from the serial ones
+static int Check(Pipeline * pipeline, const char * name) {
+    std::vector<Result> serial(NumJobs);
+    for(int i = 0; i < NumJobs; ++i) {
+        Render(pipeline, i, 1, &serial[i]);
+    }
+
+    int mismatches = 0;
+    for(uint32_t workers = 1; workers <= 3; workers += 2) {
+        std::vector<Result> concurrent(NumJobs);
+        std::vector<std::thread> threads;
+        for(int i = 0; i < NumJobs; ++i) {
+            threads.push_back(std::thread(Render, pipeline, i, workers, &concurrent[i]));
+        }
+        for(uint32_t i = 0; i < threads.size(); ++i) {
+            threads[i].join();
+        }
+
+        for(int i = 0; i < NumJobs; ++i) {
+            if (!Matches(serial[i], concurrent[i])) {
+                std::cout << name << ": job " << i << " with " << workers << " worker(s) differs from serial output" << std::endl;
+                mismatches++;
+            }
+        }
+    }
+    return mismatches;
+}
+
+
+int main() {
+    VertexShader   vShader;
+    FragmentShader fShader;
+    vShader.modelview.RotateByAngles(10, 20, 30);
+
+    // Every Program of a pipeline shares its stage instances. The output is the
+    // same for any number of workers either way: binning keeps fragments that land
+    // on the same pixels on one worker, in order, and without it the stages after
+    // the rasterizer run on a single thread.
+    int mismatches = 0;
+    for(uint16_t binSize = 0; binSize <= 32; binSize += 32) {
+        RasterizerSettings settings(Polygon::Triangles);
+        settings.binSize = binSize;
+        StageProcedure * rasterizer = CreateRasterizer(settings);
+
+        Pipeline pipeline;
+        pipeline.PushExecutionStage(&vShader);
+        pipeline.PushExecutionStage(rasterizer);
+        pipeline.PushExecutionStage(&fShader);
+        mismatches += Check(&pipeline, binSize ? "binned" : "unbinned");
+        delete rasterizer;
+    }
+
+    std::cout << (mismatches ? "FAILED" : "OK") << ": " << NumJobs << " concurrent jobs checked against serial output, binned and unbinned" << std::endl;
+    return mismatches ? 1 : 0;
+}
@@ -0,0 +1,158 @@
+#ifndef H_SOFTRASTER_COMMAND_BUFFER_INCLUDED
+#define H_SOFTRASTER_COMMAND_BUFFER_INCLUDED
+
+/* SoftRaster: CommandBuffer
+   Johnathan Corkery, 2015 */
+#include <cstdint>
+#include <vector>
+#include <SoftRaster/Texture.h>
+#include <SoftRaster/Pipeline.h>
+#include <SoftRaster/DepthBuffer.h>
+
+
+namespace SoftRaster {
+class Context;
+
+/// \brief Draws recorded to be rendered later, as many times as needed.
+///
+/// Draws are recorded with the same calls as a Context would render them, along
+/// with the framebuffer, depth buffer and program set at the time. Vertices, indices
+/// and instance data are copied in, so none of them need to stay valid after recording.
+/// Nothing is rendered until the buffer is submitted (see Context::Submit()), which
+/// may happen any number of times without recording again, such as once per frame
+/// for the parts of a scene that do not change.
+///
+/// When submitted, draws are grouped by program, then by framebuffer and depth buffer,
+/// in the order each was first used. Within a group, draws keep the order they were recorded in.
+/// Consecutive draws of a group that are of the same kind and vertex type, and have a
+/// depth buffer (see SetDepthBuffer()), are merged into a single run of the program.
+/// Strips and fans (see Topology) restart at the start of each merged draw, the same as
+/// at a RestartIndex: stages that assemble them must see restarts, as described in
+/// Pipeline::Program::SetPrimitiveRestart(). Instanced draws are never merged, and neither
+/// are draws without a depth buffer, whose rasterizers clear their own at the start of each run.
+///
+/// The order and merges are worked out on the first submit after recording,
+/// and reused by the submits after it. Since that is stored in the buffer, and since
+/// its draws run their programs, which may only be run by one Context at a time, a
+/// CommandBuffer must not be submitted (or have GetRunCount() called) from more than one
+/// thread at once. Separate buffers with separate programs may be submitted concurrently.
+///
+class CommandBuffer {
+  public:
+    CommandBuffer();
+
+    /// \brief Sets the framebuffer of the draws recorded next.
+    /// See Context::SetFramebuffer().
+    ///
+    void SetFramebuffer   (Texture *);
+
+    /// \brief Sets the depth buffer of the draws recorded next.
+    /// See Context::SetDepthBuffer().
+    ///
+    void SetDepthBuffer   (DepthBuffer *);
+
+    /// \brief Sets the program of the draws recorded next.
+    /// Draws recorded without a program are ignored.
+    ///
+    void UseProgram(Pipeline::Program * program);
+
+    /// \brief Records a draw of the given vertices.
+    /// See Context::RenderVertices().
+    ///
+    template<typename UserVertexT>
+    void RenderVertices(const UserVertexT * vertexArray, uint32_t num);
+
+    /// \brief Records an indexed draw.
+    /// See Context::RenderVerticesIndexed().
+    ///
+    /// Only the vertices up to the greatest index are copied.
+    ///
+    template<typename UserVertexT>
+    void RenderVerticesIndexed(const UserVertexT * vertexArray, const uint32_t * indexList, uint32_t numIndices);
+
+    /// \brief Records an instanced draw.
+    /// See Context::RenderInstanced().
+    ///
+    template<typename UserVertexT, typename InstanceT>
+    void RenderInstanced(const UserVertexT * vertexArray, uint32_t num, const InstanceT * instanceArray, uint32_t numInstances);
+
+    /// \brief Removes every recorded draw.
+    ///
+    /// The framebuffer, depth buffer and program stay as they were set.
+    ///
+    void Clear();
+
+    /// \brief Returns the number of draws recorded.
+    ///
+    uint32_t GetDrawCount() const;
+
+    /// \brief Returns the number of program runs a submit performs once draws are merged.
+    ///
+    uint32_t GetRunCount() const;
+
+  private:
+    friend class Context;
+    enum class DrawKind {
+        Vertices,
+        Indexed,
+        Instanced
+    };
+
+    struct Draw {
+        DrawKind kind;
+        Pipeline::Program * program;
+        Texture * framebuffer;
+        DepthBuffer * depth;
+
+        // offsets into data and indexData
+        uint32_t vertices;
+        uint32_t sizeofVertex;
+        uint32_t num;
+        uint32_t indices;
+        uint32_t numIndices;
+        uint32_t instances;
+        uint32_t sizeofInstance;
+        uint32_t numInstances;
+    };
+
+    // Consecutive draws in submit order that run as one.
+    // Merged draws are copied together; a single draw is run from where it was recorded.
+    struct Batch {
+        uint32_t first;
+        uint32_t count;
+        std::vector<uint8_t>  vertices;
+        std::vector<uint32_t> indices;
+        std::vector<uint32_t> starts;
+    };
+
+    void Record(
+        DrawKind,
+        const uint8_t * v,
+        uint32_t sizeofVertex,
+        uint32_t num,
+        const uint32_t * indices,
+        uint32_t numIndices,
+        const uint8_t * instanceData,
+        uint32_t sizeofInstance,
+        uint32_t numInstances
+    );
+    uint32_t Store(const uint8_t *, uint32_t size);
+    bool Merges(const Draw &, const Draw &) const;
+    void Plan() const;
+
+    Texture * framebuffer;
+    DepthBuffer * depth;
+    Pipeline::Program * program;
+
+    std::vector<Draw> draws;
+    std::vector<uint8_t> data;
+    std::vector<uint32_t> indexData;
+
+    mutable bool planned;
+    mutable std::vector<uint32_t> order;
+    mutable std::vector<Batch> batches;
+};
+#include <SoftRaster/CommandBufferImpl.hpp>
+}
+
+#endif
@@ -0,0 +1,44 @@
+// should never be included in anything except CommandBuffer.h
+
+
+
+template<typename T>
+void CommandBuffer::RenderVertices(
+        const T * vertexArray,
+        uint32_t num) {
+
+    Record(DrawKind::Vertices, (const uint8_t*)vertexArray, sizeof(T), num, nullptr, 0, nullptr, 0, 0);
+}
+
+template<typename T>
+void CommandBuffer::RenderVerticesIndexed(
+        const T * vertexArray,
+        const uint32_t * indexList,
+        uint32_t numIndices) {
+
+    uint32_t num = 0;
+    for(uint32_t i = 0; i < numIndices; ++i) {
+        if (indexList[i] != Pipeline::Program::RestartIndex && indexList[i] >= num) num = indexList[i]+1;
+    }
+    Record(DrawKind::Indexed, (const uint8_t*)vertexArray, sizeof(T), num, indexList, numIndices, nullptr, 0, 0);
+}
+
+template<typename T, typename InstanceT>
+void CommandBuffer::RenderInstanced(
+        const T * vertexArray,
+        uint32_t num,
+        const InstanceT * instanceArray,
+        uint32_t numInstances) {
+
+    Record(
+        DrawKind::Instanced,
+        (const uint8_t*)vertexArray,
+        sizeof(T),
+        num,
+        nullptr,
+        0,
+        (const uint8_t*)instanceArray,
+        sizeof(InstanceT),
+        numInstances
+    );
+}
@@ -10,6 +10,8 @@
 
 #include <SoftRaster/Texture.h>
 #include <SoftRaster/Pipeline.h>
+#include <SoftRaster/DepthBuffer.h>
+#include <SoftRaster/CommandBuffer.h>
 
 
 namespace SoftRaster {
@@ -39,6 +41,15 @@ class Context {
     ///
     void SetFramebuffer   (Texture *);
 
+    /// \brief Sets the depth buffer used by rasterizers of the program.
+    ///
+    /// Unlike the depth buffer a rasterizer keeps of its own, this one
+    /// persists across draws until it is cleared (see DepthBuffer::Clear()). It is resized
+    /// to match the framebuffer when needed. Like the framebuffer, it is not owned by the context.
+    /// The default, nullptr, lets each rasterizer clear its own before each draw.
+    ///
+    void SetDepthBuffer   (DepthBuffer *);
+
     /// \brief Sets the program to render with.
     /// See Pipeline and Pipeline::Program
     ///
@@ -55,16 +66,44 @@ class Context {
     /// \brief Renders the given set of indices. The indices
     /// refer to the i'th vertex in the initial vertexArray
     ///
+    /// Vertices shared by several indices are only run through the
+    /// first stage once where possible. See Pipeline::Program::SetVertexCacheSize().
+    ///
     /// UserVertexT must inherit from Vector3.
     ///
     template<typename UserVertexT>
     void RenderVerticesIndexed(UserVertexT * VertexArray, uint32_t * indexList, uint32_t numIndices);
 
+    /// \brief Renders the given set of vertices once for each instance,
+    /// in a single run of the program.
+    ///
+    /// The first stage runs over all of the vertices for the first instance, 
+    /// then for the second, and so on. It finds the instance of each iteration
+    /// with RuntimeIO::GetInstance(), and that instance's entry of instanceArray with
+    /// RuntimeIO::GetInstanceData(). The vertices are copied in at most once, not once 
+    /// for each instance, and the instance data is not copied; both only need to stay 
+    /// valid until the call returns.
+    /// Strips and fans (see Topology) restart with each instance.
+    ///
+    /// UserVertexT must inherit from Vector3.
+    ///
+    template<typename UserVertexT, typename InstanceT>
+    void RenderInstanced(UserVertexT * VertexArray, uint32_t num, const InstanceT * instanceArray, uint32_t numInstances);
+
+    /// \brief Renders every draw recorded in the given CommandBuffer.
+    ///
+    /// Draws use the framebuffer, depth buffer and program recorded with them,
+    /// rather than those set on the context. See CommandBuffer for the order they are rendered in,
+    /// and for why a buffer may only be submitted from one thread at a time.
+    ///
+    void Submit(const CommandBuffer &);
+
 
 
   private:
 
     Texture * framebuffer;
+    DepthBuffer * depth;
     Pipeline::Program * program;    
 
 };
@@ -25,6 +25,7 @@ void Context::RenderVertices(
 
     program->Run(
         framebuffer, 
+        depth,
         (uint8_t*)vertexData,
         sizeof(T),
         num
@@ -38,19 +39,44 @@ void Context::RenderVerticesIndexed(
         uint32_t numIndices) {
 
     if (!program) return;    
+    T * testInst = new T;
+    if (!dynamic_cast<Vector3 *>(testInst)) {
+        assert(!"The SoftRaster::Context template vertex type must inherit from the primitive SoftRaster::Vertex3!");
+    }
+    delete testInst;
 
-    // Only step here is to expand the vertex list
-    // NOTE: this is functional, but not ideal...
-    // Pre-allocated index array?
-    T * coreList = new T[numIndices];
-    for(uint32_t i = 0; i < numIndices; ++i) 
-        memcpy(coreList+i, vertexArray+indexList[i], sizeof(T));
-
-    RenderVertices<T>(coreList, numIndices);
-
-    delete[] coreList;
+    program->RunIndexed(
+        framebuffer,
+        depth,
+        (uint8_t*)vertexArray,
+        sizeof(T),
+        indexList,
+        numIndices
+    );
 }
 
+template<typename T, typename InstanceT>
+void Context::RenderInstanced(
+        T * vertexArray,
+        uint32_t num,
+        const InstanceT * instanceArray,
+        uint32_t numInstances) {
 
+    if (!program) return;
+    T * testInst = new T;
+    if (!dynamic_cast<Vector3 *>(testInst)) {
+        assert(!"The SoftRaster::Context template vertex type must inherit from the primitive SoftRaster::Vertex3!");
+    }
+    delete testInst;
 
-
+    program->RunInstanced(
+        framebuffer,
+        depth,
+        (uint8_t*)vertexArray,
+        sizeof(T),
+        num,
+        (const uint8_t*)instanceArray,
+        sizeof(InstanceT),
+        numInstances
+    );
+}
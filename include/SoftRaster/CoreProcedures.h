@@ -2,9 +2,254 @@
 #define H_SOFTRASTER_CORE_PROCEDURE_INCLUDED
 
 #include <SoftRaster/StageProcedure.h>
+#include <SoftRaster/DepthBuffer.h>
+#include <atomic>
 
 namespace SoftRaster {
 
+
+/// \brief Describes how a rasterizer from CreateRasterizer() should behave.
+///
+struct RasterizerSettings {
+    RasterizerSettings(
+        Polygon shape_ = Polygon::Triangles,
+        DepthBuffering depth_ = DepthBuffering::BytePrecision
+    ) :
+        shape  (shape_),
+        topology(Topology::List),
+        depth  (depth_),
+        method (RasterMethod::Barycentric),
+        vectorized(true),
+        pointSize(1),
+        binSize(0),
+        format (FragmentFormat::Vertices),
+        spans  (false),
+        varyingOffset(0),
+        varyingCount (0),
+        perspectiveOffset(-1)
+    {}
+
+    /// \brief The primitive assembled from incoming vertices.
+    ///
+    Polygon shape;
+
+    /// \brief How incoming vertices are assembled into primitives.
+    ///
+    /// With Topology::Strip or Topology::Fan, each vertex only has to be sent (and run through
+    /// earlier stages) once, while the rasterizer reuses the ones before it. Strips and fans
+    /// run across the whole draw unless restarted (see Pipeline::Program::SetPrimitiveRestart()).
+    /// Points are always assembled as a list, and so are primitives given to a PrimitiveRasterizer.
+    /// The default is Topology::List.
+    Topology topology;
+
+    /// \brief The depth buffering mode.
+    ///
+    /// This is the precision of the depth buffer the rasterizer keeps for draws 
+    /// without a depth buffer of their own (see Context::SetDepthBuffer()). 
+    /// With DepthBuffering::None, fragments are never depth tested.
+    DepthBuffering depth;
+
+    /// \brief How triangles are converted into fragments.
+    ///
+    /// RasterMethod::EdgeFunctions works in fixed-point with 4 bits of subpixel
+    /// precision, only needs additions per pixel, and never produces
+    /// the same fragment for two triangles sharing an edge. Fragment biases 
+    /// are the same as with RasterMethod::Barycentric, though pixels are 
+    /// sampled at their centers rather than their corners. Only triangles are affected.
+    RasterMethod method;
+
+    /// \brief Whether pixels are evaluated with vector instructions.
+    ///
+    /// When true (the default), RasterMethod::EdgeFunctions tests rows of pixels
+    /// with the widest instruction set the running CPU supports (see GetRasterKernelName()).
+    /// When false, a scalar version is used instead. Both produce the same fragments
+    /// bit for bit, so the scalar version serves as a reference.
+    bool vectorized;
+
+    /// \brief The width and height in pixels of the square each point covers.
+    ///
+    /// Only affects Polygon::Points. For each fragment of a point, bias0 is 1.f, while
+    /// bias1 and bias2 are the position of the pixel within the square from 0.f to 1.f, 
+    /// going right and down respectively (as texture coordinates of a point sprite would).
+    uint16_t pointSize;
+
+    /// \brief The width and height in pixels of the screen tiles used for binning.
+    ///
+    /// When 0 (the default), primitives are rasterized as they are assembled.
+    /// Otherwise, once all vertices are received, primitives are sorted into
+    /// bins of binSize-by-binSize pixels. Each bin is then rasterized, depth tested,
+    /// and passed through the rest of the pipeline on its own, so that bins may be run
+    /// on separate workers (see Pipeline::Program::SetWorkerCount()) without ever
+    /// writing to the same pixels. 64 is a good starting point. It is rounded up to
+    /// a multiple of DepthBuffer::TileSize so that bins never share depth tiles.
+    uint16_t binSize;
+
+    /// \brief What is passed on with each fragment.
+    ///
+    /// With FragmentFormat::Vertices (the default), the output signature is a Fragment
+    /// followed by a UserVertex for each vertex of the primitive, copied for every fragment.
+    /// With FragmentFormat::PrimitiveID, it is a Fragment followed by a PrimitiveID instead, 
+    /// and the next stages read the vertices with RuntimeIO::GetPrimitiveVertex(). Each primitive's
+    /// vertices are then copied once per draw rather than once per fragment.
+    FragmentFormat format;
+
+    /// \brief Whether horizontal runs of pixels are passed on rather than single pixels.
+    ///
+    /// When true, the first output slot is a Span instead of a Fragment. Neighboring 
+    /// pixels of the same primitive and row that pass the depth test are joined into 
+    /// one Span, so that the next stage may shade them in a single loop. The default is false. 
+    /// PrimitiveRasterizer always produces Fragments.
+    bool spans;
+
+    /// \brief Where the float attributes to interpolate are in each UserVertex.
+    ///
+    /// When varyingCount is more than 0, that many consecutive floats starting 
+    /// varyingOffset bytes into each UserVertex are interpolated by the rasterizer
+    /// (at most 16). The output signature then has a Float slot for each, in order, 
+    /// right after the Fragment, so that later stages can read ready-made values rather
+    /// than interpolating from the biases. Interpolation planes are set up once
+    /// per primitive and evaluated for rows of pixels at a time with the same instruction
+    /// set as GetRasterKernelName(). Varyings are not given with spans.
+    ///\{
+    uint32_t varyingOffset;
+    uint32_t varyingCount;
+    ///\}
+
+    /// \brief Where the clip space w of each vertex is in the UserVertex, for perspective correction.
+    ///
+    /// Positions given to the rasterizer are already divided by w, so varyings 
+    /// interpolated linearly across the screen are distorted under perspective. When 0 or more,
+    /// this is the byte offset of a float holding the w each vertex had before the divide,
+    /// and varyings are interpolated perspective-correctly. When -1 (the default), 
+    /// varyings are interpolated linearly in screen space. Biases and depth are unaffected.
+    int32_t perspectiveOffset;
+};
+
+/// \brief Describes how a Clipper should behave.
+///
+struct ClipperSettings {
+    ClipperSettings(
+        Polygon shape_ = Polygon::Triangles,
+        CullFace cull_ = CullFace::None
+    ) :
+        shape   (shape_),
+        topology(Topology::List),
+        cull    (cull_),
+        clockwiseFront(false),
+        cullZeroArea(true),
+        wOffset (-1),
+        guardBand(16.f)
+    {}
+
+    /// \brief The primitive assembled from incoming vertices.
+    ///
+    Polygon shape;
+
+    /// \brief How incoming vertices are assembled into primitives.
+    ///
+    /// Primitives are always passed on as a list, so a rasterizer after 
+    /// a Clipper should use Topology::List. See RasterizerSettings::topology.
+    Topology topology;
+
+    /// \brief Which triangles are removed by their winding.
+    ///
+    CullFace cull;
+
+    /// \brief Whether triangles that appear clockwise on screen face the viewer.
+    ///
+    /// The default is false, where counter-clockwise triangles face the viewer.
+    bool clockwiseFront;
+
+    /// \brief Whether triangles that cover no area on screen are removed.
+    ///
+    bool cullZeroArea;
+
+    /// \brief Where the w of each vertex's clip space position is in the UserVertex.
+    ///
+    /// When 0 or more, positions coming into the Clipper are in homogeneous clip space: the
+    /// Vector3 at the start of the UserVertex holds x, y and z, and the float this many bytes in holds w.
+    /// Outgoing positions are then divided by w, while w itself is kept so that
+    /// the rasterizer can use it for perspective correction (see RasterizerSettings::perspectiveOffset).
+    /// When -1 (the default), positions are already divided and w is taken to be 1.
+    int32_t wOffset;
+
+    /// \brief How far past the edges of the screen triangles may reach before they are clipped.
+    ///
+    /// This is in multiples of the screen's half width and height, so 1 clips 
+    /// to the screen itself. Rasterizers already skip pixels that are off-screen,
+    /// so only triangles that reach very far are worth clipping.
+    float guardBand;
+};
+
+
+/// \brief A stage that removes and clips primitives before they are rasterized.
+///
+/// A Clipper takes UserVertex inputs and gives UserVertex outputs, and belongs
+/// between the stage that transforms vertices and the rasterizer.
+/// Incoming vertices are assembled into primitives, and then:
+///
+///  - primitives entirely outside of the view volume are removed,
+///  - triangles and lines are clipped to the depth planes (z = -w and z = w, which
+///    hold the farthest and nearest depths of a DepthBuffer that is not reversed),
+///    to w > 0, and to the guard band (see ClipperSettings::guardBand),
+///  - points outside any of these planes are removed,
+///  - positions are divided by w (see ClipperSettings::wOffset), and
+///  - triangles are culled by their winding and area.
+///
+/// Triangles produced by clipping are passed on as separate triangles. Their new vertices are
+/// interpolated as if every 4 bytes of the UserVertex were a float, so UserVertex types 
+/// passed through a Clipper should only hold floats.
+///
+/// Statistics are kept across all Programs the Clipper is part of.
+///
+class Clipper : public StageProcedure {
+  public:
+    Clipper(const ClipperSettings & = ClipperSettings());
+
+    /// \brief Counts of the primitives seen by the Clipper.
+    ///
+    struct Statistics {
+        uint64_t primitives; ///< Primitives assembled from incoming vertices.
+        uint64_t outside;    ///< Primitives removed for being outside of the view volume.
+        uint64_t culled;     ///< Triangles removed for their winding.
+        uint64_t zeroArea;   ///< Triangles removed for covering no area.
+        uint64_t clipped;    ///< Triangles and lines that needed clipping.
+        uint64_t emitted;    ///< Primitives passed on to the next stage.
+
+        /// \brief Returns the fraction of assembled primitives that were removed.
+        ///
+        float GetRemovedRate() const;
+    };
+
+    /// \brief Returns the counts gathered since the last ResetStatistics().
+    ///
+    Statistics GetStatistics() const;
+
+    /// \brief Sets all counts back to 0.
+    ///
+    void ResetStatistics();
+
+
+    SignatureIO InputSignature() const;
+    SignatureIO OutputSignature() const;
+    StageState * CreateState() const;
+    void NewRun(RuntimeIO *);
+    void operator()(RuntimeIO *);
+
+    // Vertices are gathered across iterations
+    bool IsParallel() const { return false; }
+    bool IsOneToOne() const { return false; }
+
+  private:
+    Clipper(const Clipper &) = delete;
+    Clipper & operator=(const Clipper &) = delete;
+
+    ClipperSettings settings;
+    uint32_t vertexCount;
+    std::atomic<uint64_t> counts[6];
+};
+
+
 /// \brief Creates pre-defined ShaderProcedures
 ///
 StageProcedure * CreateRasterizer(
@@ -12,6 +257,52 @@ StageProcedure * CreateRasterizer(
     DepthBuffering d= DepthBuffering::BytePrecision
 );
 
+/// \brief Creates a rasterizer with the given settings.
+///
+StageProcedure * CreateRasterizer(const RasterizerSettings &);
+
+/// \brief Returns the instruction set rasterizers use on this machine.
+///
+/// This is one of "AVX-512", "AVX2", "SSE2" or "Scalar", and 
+/// is decided once from the features the CPU reports.
+const char * GetRasterKernelName();
+
+
+/// \brief Rasterizes primitives directly, outside of a Pipeline.
+///
+/// This is the same rasterization and depth testing performed by the 
+/// stage from CreateRasterizer(), for code that assembles primitives itself 
+/// (see TypedPipeline). Binning is not done.
+///
+class PrimitiveRasterizer {
+  public:
+    PrimitiveRasterizer(const RasterizerSettings & = RasterizerSettings());
+    ~PrimitiveRasterizer();
+
+    /// \brief Returns the number of vertices in each primitive.
+    ///
+    uint32_t GetVertexCount() const;
+
+    /// \brief Prepares for a new draw to the given framebuffer.
+    ///
+    /// Fragments are tested against the given depth buffer, which is
+    /// resized to match the framebuffer if needed. Without one, the rasterizer's
+    /// own depth buffer is cleared and used instead.
+    void Begin(Texture * framebuffer, DepthBuffer * depth = nullptr);
+
+    /// \brief Rasterizes the primitive made of GetVertexCount() vertices.
+    ///
+    /// Each fragment that passes the depth test is appended to out.
+    void Rasterize(const Vector3 * const * vertices, std::vector<Fragment> & out);
+
+  private:
+    PrimitiveRasterizer(const PrimitiveRasterizer &) = delete;
+    PrimitiveRasterizer & operator=(const PrimitiveRasterizer &) = delete;
+
+    StageProcedure * core;
+    StageState * state;
+};
+
 
 
 }
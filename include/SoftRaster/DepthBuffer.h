@@ -0,0 +1,115 @@
+#ifndef H_SOFTRASTER_DEPTH_BUFFER_INCLUDED
+#define H_SOFTRASTER_DEPTH_BUFFER_INCLUDED
+
+/* SoftRaster: DepthBuffer
+   Johnathan Corkery, 2015 */
+#include <cstdint>
+#include <SoftRaster/Primitives.h>
+
+namespace SoftRaster {
+
+/// \brief Per-pixel depths used to decide which fragments are kept.
+///
+/// Depths are given as homogenous z from -1.f to 1.f. By default, a fragment
+/// passes if it has a greater z than what was stored, and a clear depth buffer
+/// holds the farthest depth (-1.f). When reversed, fragments with a lesser z pass
+/// instead and the farthest depth is 1.f. Fragments outside of [-1.f, 1.f] never pass.
+///
+/// Depths are stored in 8 bits, 16 bits, or as floats according to the DepthBuffering
+/// given (DepthBuffering::None is treated as BytePrecision).
+///
+/// Clearing takes the same time regardless of size: the buffer is split into
+/// tiles of TileSize-by-TileSize pixels that are each only cleared once they are
+/// written to again. Alongside the depths, the farthest depth of each
+/// tile is kept so that rasterizers can skip whole regions that would
+/// fail the test (see Rejects()).
+///
+/// A DepthBuffer may be attached to a Context (see Context::SetDepthBuffer())
+/// so that it persists across draws. Otherwise, rasterizers keep their own
+/// that is cleared before each draw.
+///
+class DepthBuffer {
+  public:
+    /// \brief Width and height in pixels of each tile.
+    ///
+    static const int TileSize = 8;
+
+    DepthBuffer(DepthBuffering precision = DepthBuffering::BytePrecision, bool reversed = false);
+    ~DepthBuffer();
+
+    /// \brief Sets every depth to the farthest depth.
+    ///
+    void Clear();
+
+    /// \brief Changes the size of the buffer, clearing it.
+    ///
+    void Resize(uint16_t w, uint16_t h);
+
+    /// \brief Returns the width of the buffer.
+    ///
+    inline uint16_t Width() const { return w; }
+
+    /// \brief Returns the height of the buffer.
+    ///
+    inline uint16_t Height() const { return h; }
+
+    /// \brief Returns how depths are stored.
+    ///
+    inline DepthBuffering GetPrecision() const { return precision; }
+
+    /// \brief Returns whether fragments with lesser z pass.
+    ///
+    inline bool IsReversed() const { return reversed; }
+
+    /// \brief Tests the depth of a fragment at the given position.
+    ///
+    /// Like a Fragment, the position is from the top left of the buffer.
+    /// If the depth passes, it is written and true is returned.
+    bool Test(uint16_t x, uint16_t y, float homogenousZ);
+
+    /// \brief Returns the depth stored at the given position as homogenous z.
+    ///
+    /// The depth is returned at the precision it is stored at. Positions
+    /// are the same as for Test(), and bounds checking is not done.
+    float GetDepth(uint16_t x, uint16_t y) const;
+
+    /// \brief Returns whether every fragment within the given pixels would fail.
+    ///
+    /// The pixels are [x0, x1) by [y0, y1), where y counts up from the
+    /// bottom of the buffer like it does when rasterizing. minZ and maxZ
+    /// bound the depths of the fragments. This is conservative: false
+    /// may be returned even if all would fail.
+    bool Rejects(int x0, int y0, int x1, int y1, float minZ, float maxZ);
+
+  private:
+    DepthBuffer(const DepthBuffer &) = delete;
+    DepthBuffer & operator=(const DepthBuffer &) = delete;
+
+    template<typename T>
+    bool TestAs(uint16_t x, uint16_t y, uint32_t key);
+    template<typename T>
+    uint32_t Farthest(uint32_t tile, int tx, int ty);
+
+    uint32_t KeyOf(float homogenousZ) const;
+    uint32_t Quantize(float) const;
+    void ClaimTile(uint32_t tile, int tx, int ty);
+
+    DepthBuffering precision;
+    bool reversed;
+    uint8_t unitSize;
+
+    uint8_t  * data;
+    uint32_t * tileGeneration;
+    uint32_t * tileFarthest;
+    uint8_t  * tileDirty;
+    uint32_t generation;
+
+    uint16_t w;
+    uint16_t h;
+    uint32_t tilesX;
+    uint32_t numTiles;
+};
+
+}
+
+#endif
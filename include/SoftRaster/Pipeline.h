@@ -11,6 +11,32 @@
 
 namespace SoftRaster {
 class StageProcedure;
+class StageState;
+class RuntimeIO;
+class WorkerPool;
+class DepthBuffer;
+
+
+/// \brief The byte layout of a stage's input and output slots.
+///
+/// Layouts are resolved once by Pipeline::Compile(). Because the size of a 
+/// UserVertex is only known when drawing, each slot location is kept as 
+/// the size of the fixed slots before it plus the number of UserVertex slots 
+/// before it, and the final locations are only patched when the size of the 
+/// vertex changes. Used internally by Pipeline::Program and RuntimeIO.
+///
+struct StageLayout {
+    void Build(const StageProcedure *);
+    void Patch(uint32_t sizeofVertex);
+
+    std::vector<uint32_t> argInLocs;  ///< Location of each input slot, followed by the input size.
+    std::vector<uint32_t> argOutLocs; ///< Location of each output slot, followed by the output size.
+
+    std::vector<uint32_t> inFixed;
+    std::vector<uint32_t> inVertices;
+    std::vector<uint32_t> outFixed;
+    std::vector<uint32_t> outVertices;
+};
 /// \brief The Pipeline controls how the rendering process occurs. 
 ///
 /// Rendering of vertices is done by following transformations of data over a series of stages.
@@ -29,6 +55,11 @@ class Pipeline {
     /// Though, the program is the unit that actually performs the rendering. 
     /// Refer to Context for usage.
     ///
+    /// All of the state used while rendering is owned by the Program, so separate
+    /// Programs may be run at the same time from separate threads, even if 
+    /// they were compiled from the same Pipeline. A single Program may only be 
+    /// run by one Context at a time.
+    ///
     class Program {
       public:
         ~Program();
@@ -39,18 +70,185 @@ class Pipeline {
         ///
         std::string GetStatus();
 
+        /// \brief Sets the number of threads that run each stage.
+        ///
+        /// The default is 1, where every stage is run on the calling thread.
+        /// With more workers, the iterations of each stage are split into
+        /// chunks that are run concurrently, each worker committing into its own
+        /// output region. Once the stage is finished, the outputs are joined
+        /// to form the input of the next stage. Any StageProcedure that 
+        /// reports StageProcedure::IsParallel() must be safe to call from
+        /// multiple threads at once when this is used. Stages after one that is
+        /// not parallel run on a single thread too, unless that stage splits them
+        /// into partitions (such as a rasterizer with RasterizerSettings::binSize).
+        ///
+        void SetWorkerCount(uint32_t);
+
+        /// \brief Returns the number of threads that run each stage.
+        ///
+        uint32_t GetWorkerCount() const;
+
+        /// \brief Sets the number of outputs that are passed between stages at a time.
+        ///
+        /// By default (0), each stage runs over all of its inputs before the next
+        /// stage starts, so the full output of a stage is held in memory at once.
+        /// With a chunk size, the Program instead streams: input vertices are 
+        /// given to the first stage chunkSize at a time, and as soon as any stage 
+        /// has committed chunkSize outputs, they are run through the next stage. 
+        /// Memory held between stages is then bound by the chunk size rather than by the draw.
+        ///
+        /// While streaming, RuntimeIO iteration indices are relative to the chunk
+        /// being run. Streaming runs on the calling thread and does not use partitions.
+        ///
+        void SetChunkSize(uint32_t chunkSize);
+
+        /// \brief Returns the number of outputs passed between stages at a time.
+        ///
+        uint32_t GetChunkSize() const;
+
+        /// \brief Sets how transformed vertices are reused by indexed draws.
+        ///
+        /// For indexed draws (see Context::RenderVerticesIndexed()), the first stage
+        /// is only run for the vertices the indices refer to, and the next stage 
+        /// reads the results through the indices. By default (0), every referenced 
+        /// vertex is run exactly once. With a cache size, the indices are instead 
+        /// walked through a least-recently-used cache of that many vertices,
+        /// and a vertex is run again whenever it has fallen out of the cache. 
+        ///
+        /// Reuse requires the first stage to commit exactly once for each of its
+        /// iterations, as reported by StageProcedure::IsOneToOne(). If it does not, or
+        /// if the Program streams (see SetChunkSize()), indexed draws run the first stage
+        /// once for each index. A first stage that reports being one-to-one but does not
+        /// commit once per iteration has its results discarded and is run again once per index.
+        ///
+        void SetVertexCacheSize(uint32_t entries);
+
+        /// \brief Returns the number of vertices kept for reuse by indexed draws.
+        ///
+        uint32_t GetVertexCacheSize() const;
+
+        /// \brief The index that ends the current strip or fan of an indexed draw.
+        ///
+        static const uint32_t RestartIndex = UINT32_MAX;
+
+        /// \brief Sets whether indexed draws may restart strips and fans.
+        ///
+        /// When enabled, RestartIndex is not drawn but instead marks the start of a 
+        /// new strip or fan (see Topology), so that many strips can be drawn at once. 
+        /// Stages that assemble primitives learn of restarts through RuntimeIO::IsRestart().
+        /// Restarts are seen by the stage that reads the vertices in index order, and by
+        /// each following stage for as long as every stage before it is one-to-one (see 
+        /// StageProcedure::IsOneToOne()), commits exactly once for each of its iterations,
+        /// and is not split into partitions. The default is false.
+        ///
+        void SetPrimitiveRestart(bool);
+
+        /// \brief Returns whether indexed draws may restart strips and fans.
+        ///
+        bool GetPrimitiveRestart() const;
+
+
+        /// \brief Counters gathered while the Program runs.
+        ///
+        struct Statistics {
+            Statistics();
+
+            uint64_t indices;           ///< Indices drawn by indexed draws.
+            uint64_t vertexInvocations; ///< Iterations of the first stage run for those indices.
+
+            /// \brief Returns the fraction of indices that reused a transformed vertex.
+            ///
+            float GetVertexCacheHitRate() const;
+        };
+
+        /// \brief Returns the counters gathered since the last ResetStatistics().
+        ///
+        const Statistics & GetStatistics() const;
+
+        /// \brief Sets all counters back to 0.
+        ///
+        void ResetStatistics();
+
       private:
         friend class Context;
         friend class Pipeline;
         void Run(
             Texture * framebuffer,
+            DepthBuffer * depth,
             uint8_t * v, 
             uint32_t sizeofVertex, 
-            uint32_t num
+            uint32_t num,
+            const uint32_t * starts = nullptr,
+            uint32_t numStarts = 0
+        );
+
+        void RunIndexed(
+            Texture * framebuffer,
+            DepthBuffer * depth,
+            uint8_t * v,
+            uint32_t sizeofVertex,
+            const uint32_t * indices,
+            uint32_t numIndices,
+            bool restart = false
+        );
+
+        void RunInstanced(
+            Texture * framebuffer,
+            DepthBuffer * depth,
+            uint8_t * v,
+            uint32_t sizeofVertex,
+            uint32_t num,
+            const uint8_t * instanceData,
+            uint32_t sizeofInstance,
+            uint32_t numInstances
         );
 
         Program(const std::string s);
+        void UseVertexSize(uint32_t sizeofVertex);
+        void RunStages(uint32_t first, const uint32_t * indices, uint32_t numIndices);
+        const uint32_t * RemoveRestarts(const uint32_t * indices, uint32_t & numIndices, bool restart);
+        void BuildIndexTable(const uint32_t * indices, uint32_t numIndices);
+        void RunStage(uint32_t stage);
+        void RunPartitions(uint32_t stage, uint32_t count);
+        void RunStreamed(Texture *, DepthBuffer *, uint8_t *, uint32_t sizeofVertex, uint32_t num);
+        void RunChunk(uint32_t stage);
+        void Flush(uint32_t stage);
+        bool KeepsRestarts(uint32_t stage, const RuntimeIO &) const;
+        friend class RuntimeIO;
+
         std::vector<StageProcedure*> cachedProcs;
+        std::vector<StageLayout> layouts;
+        uint32_t layoutVertexSize;
+        std::vector<StageState*> states;
+        std::vector<RuntimeIO*> runtimes;
+        std::vector<RuntimeIO*> streams;
+        WorkerPool * workers;
+        uint32_t chunkSize;
+
+        // indexed draws
+        struct CachedVertex {
+            uint32_t vertex;
+            uint32_t slot;
+            uint32_t used;
+        };
+        std::vector<uint32_t> vertexList;
+        std::vector<uint32_t> indexTable;
+        std::vector<uint32_t> vertexSlots;
+        std::vector<CachedVertex> vertexCache;
+        std::vector<uint8_t> expanded;
+
+        // indices without their restarts, and the positions where strips or fans restart
+        bool primitiveRestart;
+        std::vector<uint32_t> compacted;
+        std::vector<uint32_t> restarts;
+
+        // instanced draws. The first stage reads vertex i%instanceVertices for iteration i.
+        const uint8_t * instances;
+        uint32_t sizeofInstance;
+        uint32_t instanceVertices;
+        std::vector<uint32_t> instanceTable;
+        Statistics stats;
+
         Texture * src;    
         std::string status;
     };
@@ -97,6 +295,9 @@ class Pipeline {
 class RuntimeIO {
   public:
     RuntimeIO();
+    ~RuntimeIO();
+    RuntimeIO(const RuntimeIO &) = delete;
+    RuntimeIO & operator=(const RuntimeIO &) = delete;
 
     /// \brief Reads the next DataPrimitive into the given pointer. 
     ///
@@ -119,6 +320,18 @@ class RuntimeIO {
     ///
     inline uint8_t * GetReadPointer() { return inputCacheIter; }
 
+    /// \brief Returns the start of the memory block containing the 
+    /// input information for the given iteration.
+    ///
+    /// This allows for reading the inputs of iterations other than the current one.
+    /// Indices are always in terms of the stage's inputs, even if the stage
+    /// is running a partition (see StageProcedure::GetPartitionCount()).
+    /// For the stage after the first in an indexed draw, iterations are mapped through
+    /// the index buffer, so different iterations may share the same input. Likewise, the
+    /// first stage of an instanced draw reads the same vertices for every instance.
+    ///
+    inline uint8_t * GetReadPointer(uint32_t iteration) { return InputAt(iteration); }
+
     /// \brief returns the number of bytes of the memory block 
     /// pointed to by GetReadPointer()
     ///
@@ -148,7 +361,22 @@ class RuntimeIO {
     /// \brief returns the number of bytes of the memory block 
     /// pointed to by GetWritePointer()
     ///
-    inline uint32_t GetWriteSize() const {return inputSize; }
+    inline uint32_t GetWriteSize() const {return outputSize; }
+
+
+    /// \brief Returns space for count outputs to be written at once.
+    ///
+    /// The outputs are laid out one after another, each GetWriteSize() bytes
+    /// and following the OutputSignature(). Once written, they must be committed 
+    /// with CommitSpan(). The pointer is only valid until the next Commit() or CommitSpan().
+    ///
+    uint8_t * GetWriteSpan(uint32_t count);
+
+    /// \brief Commits the first count outputs written through GetWriteSpan().
+    ///
+    /// This is equivalent to writing and calling Commit() for each of them.
+    ///
+    void CommitSpan(uint32_t count);
 
 
 
@@ -169,6 +397,69 @@ class RuntimeIO {
     ///
     inline Texture * GetFramebuffer()const { return fb; }
 
+    /// \brief Returns the depth buffer given for this render, if any.
+    ///
+    /// See Context::SetDepthBuffer().
+    inline DepthBuffer * GetDepthBuffer() const { return depth; }
+
+    /// \brief Returns the working state of the running StageProcedure.
+    ///
+    /// See StageProcedure::CreateState().
+    inline StageState * GetState() const { return state; }
+
+    /// \brief Returns the given vertex of a primitive from the primitive table of the draw.
+    ///
+    /// Rasterizers that pass on a PrimitiveID with each fragment rather than
+    /// copies of the source vertices (see FragmentFormat::PrimitiveID) keep 
+    /// the vertices of each primitive in a table, which later stages read through this.
+    /// The result is only valid until the current iteration ends.
+    inline const uint8_t * GetPrimitiveVertex(uint32_t primitive, uint32_t vertex) const {
+        return primitiveTable + primitive*primitiveSize + vertex*sizeofVertex;
+    }
+
+    /// \brief Sets the primitive table read by GetPrimitiveVertex() for the remainder of the draw.
+    ///
+    /// Each primitive takes sizeofPrimitive bytes, holding its vertices one after another.
+    /// The table is owned by the caller and must stay valid while later stages
+    /// may read from it.
+    void SetPrimitiveTable(const uint8_t * table, uint32_t sizeofPrimitive);
+
+    /// \brief Returns whether a new strip or fan starts at the given iteration.
+    ///
+    /// This is true for the iterations right after a restart of an indexed draw 
+    /// (see Pipeline::Program::SetPrimitiveRestart()). Stages that assemble 
+    /// primitives check this before adding the vertex of an iteration.
+    inline bool IsRestart(uint32_t iteration) const { return numRestarts && FindRestart(iteration); }
+
+    /// \brief Returns the instance the given iteration belongs to.
+    ///
+    /// In instanced draws (see Context::RenderInstanced()), the first stage runs over
+    /// every vertex once for each instance in turn, and this is the index of the instance.
+    /// It is always 0 for other draws and for later stages.
+    inline uint32_t GetInstance(uint32_t iteration) const { 
+        return instanceVertices ? (instanceBase + iteration) / instanceVertices : 0; 
+    }
+
+    /// \brief Returns the instance the current iteration belongs to.
+    ///
+    inline uint32_t GetInstance() const { return GetInstance(currentProcIter); }
+
+    /// \brief Returns the data given for the instance, or nullptr if there is none.
+    ///
+    /// Like GetInstance(), this is only for the first stage of instanced draws. 
+    inline const uint8_t * GetInstanceData(uint32_t instance) const { 
+        return instanceData ? instanceData + instance*instanceSize : nullptr; 
+    }
+
+    /// \brief Returns the data given for the instance of the current iteration.
+    ///
+    inline const uint8_t * GetInstanceData() const { return GetInstanceData(GetInstance()); }
+
+    /// \brief Returns the partition being run, if any.
+    ///
+    /// See StageProcedure::GetPartitionCount(). 
+    inline uint32_t GetPartition() const { return partition; }
+
 
 
     /// \brief Commits the written data and marks the end of the output iteration
@@ -188,11 +479,28 @@ class RuntimeIO {
 
   private:
     friend class Pipeline::Program;
-    void RunSetup(uint8_t * vdata, uint32_t szVertex, uint32_t numIterations, Texture *);
-    void NextProc(const StageProcedure *);
+    friend class StageProcedure;
+    void RunSetup(uint8_t * vdata, uint32_t szVertex, uint32_t numIterations, Texture *, DepthBuffer *);
+    void RunSetupIndexed(uint8_t * vdata, uint32_t szVertex, const uint32_t * vertexList, uint32_t numIterations, Texture *, DepthBuffer *);
+    void NextProc(const StageLayout *, StageState *, const uint32_t * indices = nullptr, uint32_t numIndices = 0);
+    void SetLayout(const StageLayout *);
+    void BeginStream(const StageLayout *, StageState *, uint32_t szVertex, Texture *, DepthBuffer *, Pipeline::Program *, uint32_t level, uint32_t flushAt);
+    void Feed(uint8_t * records, uint32_t count, const uint32_t * indices = nullptr);
+    void EndStream();
     void NextIter();
+    void RunBatch(StageProcedure *, uint32_t count);
+    void ShareStage(const RuntimeIO &);
+    void SeekIteration(uint32_t);
+    void BeginPartition(uint32_t partition, uint32_t numIterations);
+    void Gather(const RuntimeIO &, uint32_t first, uint32_t count);
+    void SetRestarts(const uint32_t * positions, uint32_t count, uint32_t base);
+    void SetInstances(const uint8_t * data, uint32_t sizeofInstance, uint32_t verticesPerInstance, uint32_t base);
+    bool FindRestart(uint32_t iteration) const;
     void PrepareInputCache(uint32_t bytes);
     void PrepareOutputCache(uint32_t bytes);
+    inline uint8_t * InputAt(uint32_t iteration) const {
+        return inputBlock + (indexTable ? indexTable[iteration] : iteration)*inputSize;
+    }
     
 
     uint32_t iterSlotIn;    
@@ -204,18 +512,44 @@ class RuntimeIO {
     uint32_t currentProcIter;
     uint32_t procIterCount;
     uint32_t commitCount;
+    uint32_t partition;
 
-    std::vector<uint32_t> argInLocs;
-    std::vector<uint32_t> argOutLocs;
+    const uint32_t * argInLocs;
+    const uint32_t * argOutLocs;
+    uint32_t argInCount;
+    uint32_t argOutCount;
 
     uint8_t * inputCache;
     uint8_t * outputCache;
+    uint8_t * inputBlock;
+    const uint32_t * indexTable;
     uint8_t * inputCacheIter;
     uint8_t * outputCacheIter;
     uint32_t inputCacheSize;
     uint32_t outputCacheSize;
 
     Texture * fb;
+    DepthBuffer * depth;
+    StageState * state;
+
+    const uint8_t * primitiveTable;
+    uint32_t primitiveSize;
+
+    // restart positions, in terms of the iterations of the index list
+    const uint32_t * restarts;
+    uint32_t numRestarts;
+    uint32_t restartBase; // position of iteration 0
+    mutable uint32_t restartCursor;
+
+    // instances of the first stage of an instanced draw
+    const uint8_t * instanceData;
+    uint32_t instanceSize;
+    uint32_t instanceVertices;
+    uint32_t instanceBase; // iteration 0 is this many vertices into the draw
+
+    Pipeline::Program * stream;
+    uint32_t streamLevel;
+    uint32_t flushCount;
 };
 
 
@@ -26,7 +26,7 @@ namespace SoftRaster {
 template<typename T>
 void RuntimeIO::ReadNext(T * data) {
   #ifdef SOFTRASTER_RT_CHECKS
-    if (iterSlotIn > argInLocs.size())
+    if (iterSlotIn > argInCount)
         SR_RT_DEBUG_print(false, true, currentProcIter, procIterCount, "ReadNext| read past slot count promised by InputSignature()"); 
     
     if (sizeof(T) != argInLocs[iterSlotIn+1] - argInLocs[iterSlotIn]) {
@@ -40,7 +40,7 @@ void RuntimeIO::ReadNext(T * data) {
 template<typename T>
 void RuntimeIO::ReadSlot(uint32_t slot, T * data) {
   #ifdef SOFTRASTER_RT_CHECKS
-    if (slot > argInLocs.size())
+    if (slot > argInCount)
         SR_RT_DEBUG_print(false, true, currentProcIter, procIterCount, "ReadSlot| slot is invalid"); 
 
 
@@ -56,7 +56,7 @@ void RuntimeIO::ReadSlot(uint32_t slot, T * data) {
 template<typename T>
 void RuntimeIO::WriteNext(const T * g) {
   #ifdef SOFTRASTER_RT_CHECKS
-    if (iterSlotOut > argOutLocs.size())
+    if (iterSlotOut > argOutCount)
         SR_RT_DEBUG_print(false, false, currentProcIter, procIterCount, "WriteNext| read past slot count promised by InputSignature()"); 
     
     if (sizeof(T) != argOutLocs[iterSlotOut+1] - argOutLocs[iterSlotOut]) {
@@ -74,7 +74,7 @@ void RuntimeIO::WriteNext(const T * g) {
 template<typename T>
 void RuntimeIO::WriteSlot(uint32_t slot, const T * g) {
   #ifdef SOFTRASTER_RT_CHECKS
-    if (slot > argOutLocs.size())
+    if (slot > argOutCount)
         SR_RT_DEBUG_print(false, false, currentProcIter, procIterCount, "WriteSlot| read past slot count promised by InputSignature()"); 
     
     if (sizeof(T) != argOutLocs[slot+1] - argOutLocs[slot]) {
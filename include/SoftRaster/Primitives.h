@@ -11,6 +11,14 @@ enum class Polygon {
     Points     ///< 1 point.
 };
 
+/// \brief How consecutive vertices are assembled into primitives.
+///
+enum class Topology {
+    List,  ///< Each primitive has vertices of its own.
+    Strip, ///< Each vertex past the first primitive of a strip forms a new primitive with the vertices just before it. Every other triangle swaps its first two vertices so that all keep the same winding.
+    Fan    ///< Each vertex past the first primitive of a fan forms a new primitive with the first vertex of the fan (and, for triangles, the vertex just before it).
+};
+
 /// \brief Depth buffering mode.
 ///
 enum class DepthBuffering {
@@ -20,6 +28,28 @@ enum class DepthBuffering {
     None            ///< Does not perform any depth buffering. All fragments pass the depth test.
 };
 
+/// \brief How a rasterizer decides which pixels a triangle covers.
+///
+enum class RasterMethod {
+    Barycentric,   ///< Tests each pixel of the bounding box through the barycentric transform of the triangle.
+    EdgeFunctions  ///< Steps fixed-point edge functions across pixel centers, with a top-left fill rule so that pixels on shared edges are only covered once.
+};
+
+/// \brief Which triangles are removed by their winding.
+///
+enum class CullFace {
+    None,  ///< No triangles are culled for their winding.
+    Back,  ///< Triangles facing away are culled.
+    Front  ///< Triangles facing towards the viewer are culled.
+};
+
+/// \brief What a rasterizer passes on with each fragment.
+///
+enum class FragmentFormat {
+    Vertices,   ///< A Fragment followed by a copy of each UserVertex of the source primitive.
+    PrimitiveID ///< A Fragment followed by the PrimitiveID of the source primitive. See RuntimeIO::GetPrimitiveVertex().
+};
+
 
 /// \brief Enumeration of data type primitives.
 ///
@@ -32,7 +62,9 @@ enum class DataType {
     Vector4,       ///< Represents a Vector4 object.
     Mat4,          ///< Represents a Mat4 object.
     Fragment,      ///< Represents a Fragment
-    UserVertex     ///< Represents the UserVertexT supplied to the Context when rendering. 
+    UserVertex,    ///< Represents the UserVertexT supplied to the Context when rendering. 
+    PrimitiveID,   ///< Represents a 32-bit unsigned index into the primitive table of the draw. See RuntimeIO::GetPrimitiveVertex().
+    Span           ///< Represents a Span
 };
 
 
@@ -76,6 +108,25 @@ struct Fragment {
 };
 
 
+/// \brief A horizontal run of rasterized pixels from the same primitive.
+///
+/// Covers the pixels from x0 up to (but not including) x1 on row y, where positions 
+/// are the same as those of a Fragment. The biases of the first pixel are given, and each
+/// pixel after it adds the deltas, so the pixel at x has bias0 + (x - x0)*delta0, and so on.
+struct Span {
+    uint16_t x0; ///< X position of the first pixel on the target texture.
+    uint16_t x1; ///< X position one past the last pixel.
+    uint16_t y;  ///< Y position of the row on the target texture.
+
+    float bias0;  ///< The bias of the first pixel towards the first vertex.
+    float bias1;  ///< The bias of the first pixel towards the second vertex.
+    float bias2;  ///< The bias of the first pixel towards the third vertex.
+    float delta0; ///< The change in bias0 from one pixel to the next.
+    float delta1; ///< The change in bias1 from one pixel to the next.
+    float delta2; ///< The change in bias2 from one pixel to the next.
+};
+
+
 /// \brief A 4-by-4 matrix consisting of 16 floating point numbers
 ///
 struct Mat4 {
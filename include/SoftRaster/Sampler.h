@@ -0,0 +1,89 @@
+#ifndef H_SOFTRASTER_SAMPLER_INCLUDED
+#define H_SOFTRASTER_SAMPLER_INCLUDED
+
+/* SoftRaster: Sampler
+   Johnathan Corkery, 2015 */
+#include <cstdint>
+#include <SoftRaster/Texture.h>
+
+namespace SoftRaster {
+
+struct SampleParams;
+
+/// \brief Reads filtered pixels from any Texture.
+///
+/// A Sampler holds how to sample (the filter, and how positions outside the
+/// image are addressed along each axis), separate from what is sampled, so one
+/// may be shared by any number of textures and threads. Positions are normalized,
+/// with 0.f and 1.f at the edges of the image, and filters follow Texture::SampleRule.
+///
+/// Besides single samples, a whole quad or span of positions may be sampled in one
+/// call (see SampleBatch()), which reads several pixels at a time on CPUs with
+/// vector gathers. Textures whose sides are powers of two wrap fastest.
+///
+class Sampler {
+  public:
+
+    /// \brief Denotes how positions outside of 0.f to 1.f are read.
+    ///
+    enum class Wrap {
+        Clamp,  ///< The nearest edge pixels are read. This is the default.
+        Repeat, ///< The image repeats every 1.f.
+        Mirror  ///< The image repeats every 2.f, flipped every other time.
+    };
+
+    Sampler(Texture::SampleRule filter = Texture::SampleRule::Basic, Wrap wrap = Wrap::Clamp);
+
+    /// \brief Sets how the pixels around a position are combined.
+    ///
+    void SetFilter(Texture::SampleRule);
+
+    /// \brief Returns how the pixels around a position are combined.
+    ///
+    inline Texture::SampleRule GetFilter() const { return filter; }
+
+    /// \brief Sets how positions outside the image are read along x (u) and y (v).
+    ///
+    ///\{
+    void SetWrap(Wrap);
+    void SetWrap(Wrap u, Wrap v);
+    ///\}
+
+    /// \brief Returns how positions outside the image are read along x.
+    ///
+    inline Wrap GetWrapU() const { return wrapU; }
+
+    /// \brief Returns how positions outside the image are read along y.
+    ///
+    inline Wrap GetWrapV() const { return wrapV; }
+
+    /// \brief Samples the texture at (u, v) and writes the 4-byte pixel.
+    ///
+    /// The level of detail picks mipmap levels as in Texture::SamplePixel().
+    ///\{
+    void Sample(const Texture *, float u, float v, uint8_t * pixel) const;
+    void Sample(const Texture *, float u, float v, float lod, uint8_t * pixel) const;
+    ///\}
+
+    /// \brief Samples the texture at count positions, all at the same level of detail.
+    ///
+    /// Position i is (u[i], v[i]) and its pixel is written to pixels + 4*i,
+    /// the same as Sample() would write it. Positions are read BatchSize
+    /// at a time with vector instructions where the CPU supports them, so
+    /// sampling a quad or span at once is faster than sampling each pixel.
+    void SampleBatch(const Texture *, const float * u, const float * v, uint32_t count, float lod, uint8_t * pixels) const;
+
+    /// \brief The number of positions read at a time by SampleBatch().
+    ///
+    static const uint32_t BatchSize = 8;
+
+  private:
+    void Prepare(const Texture *, float lod, SampleParams &) const;
+
+    Texture::SampleRule filter;
+    Wrap wrapU, wrapV;
+};
+}
+
+
+#endif
@@ -5,11 +5,15 @@
    Johnathan Corkery, 2015 */
 #define SOFTRASTER_RT_CHECKS
 #include <SoftRaster/Context.h>
+#include <SoftRaster/CommandBuffer.h>
 #include <SoftRaster/Texture.h>
+#include <SoftRaster/Sampler.h>
 #include <SoftRaster/StageProcedure.h>
 #include <SoftRaster/Primitives.h>
 #include <SoftRaster/Pipeline.h>
+#include <SoftRaster/DepthBuffer.h>
 #include <SoftRaster/CoreProcedures.h>
+#include <SoftRaster/TypedPipeline.h>
 
 
 
@@ -12,6 +12,20 @@
 namespace SoftRaster {
 
 
+/// \brief Working storage of a StageProcedure.
+///
+/// A StageProcedure that needs to keep data between iterations or between runs
+/// (such as the primitive being assembled or a depth buffer) should keep it in a
+/// StageState rather than in itself. Each Pipeline::Program creates its own state 
+/// for every stage it runs (see StageProcedure::CreateState()), so the same 
+/// StageProcedure instance can be run by several Programs on separate threads.
+///
+class StageState {
+  public:
+    virtual ~StageState(){}
+};
+
+
 /// \brief A single Pipeline computation unit.
 ///
 /// A StageProcedure is a functor that processes data
@@ -28,6 +42,7 @@ namespace SoftRaster {
 /// 
 class StageProcedure {
   public:
+    virtual ~StageProcedure(){}
 
 
     /// \brief Holds a sequence of data types
@@ -72,6 +87,76 @@ class StageProcedure {
     ///
     virtual void operator()(RuntimeIO *) = 0;
 
+    /// \brief Runs count iterations of the procedure in one call.
+    ///
+    /// The inputs of the iterations are contiguous: the first is at RuntimeIO::GetReadPointer()
+    /// and each next one is RuntimeIO::GetReadSize() bytes after the last. Outputs may be
+    /// written in bulk through RuntimeIO::GetWriteSpan() and RuntimeIO::CommitSpan().
+    /// Overriding this lets a procedure work through its inputs in a tight loop 
+    /// instead of paying for a call per iteration. Once it returns, all count 
+    /// iterations are considered done.
+    ///
+    /// When running a partition (see GetPartitionCount()), when reading the results 
+    /// of the first stage of an indexed draw, or in the first stage of an instanced draw
+    /// (which reads the same vertices again for each instance), the inputs are not contiguous
+    /// and should be found with RuntimeIO::GetReadPointer(uint32_t) instead. That is
+    /// always correct, so a procedure that may be used in any of these can simply use it throughout.
+    /// The default calls operator() for each iteration.
+    virtual void Batch(RuntimeIO *, uint32_t count);
+
+    /// \brief Creates the working state that RuntimeIO::GetState() returns for this procedure.
+    ///
+    /// Called once for each Pipeline::Program that this procedure is compiled into.
+    /// The Program owns the result. The default returns nullptr.
+    virtual StageState * CreateState() const { return nullptr; }
+
+    /// \brief Called once each time the Pipeline::Program is run, before
+    /// any iterations of this procedure.
+    ///
+    /// The given RuntimeIO holds all of the inputs for this stage, so it
+    /// may be used to prepare data that is shared across iterations.
+    /// The default does nothing.
+    virtual void NewRun(RuntimeIO *) {}
+
+    /// \brief Returns the number of partitions this procedure's work was split into.
+    ///
+    /// This is asked right after NewRun(). When more than 1 is returned, this stage and
+    /// every stage after it are run once for each partition rather than once for all
+    /// inputs. A single partition is carried through the rest of the pipeline by one 
+    /// worker, and different partitions may be run at the same time (see Pipeline::Program::SetWorkerCount()).
+    /// This is meant for stages that divide the framebuffer, where outputs from different 
+    /// partitions never touch the same pixels.
+    ///
+    /// While running a partition, RuntimeIO::GetPartition() returns which one is
+    /// being run and the procedure is given GetPartitionIterations() iterations. These
+    /// iterations are not tied to an input; use RuntimeIO::GetReadPointer(uint32_t)
+    /// to read them. The default is 0.
+    virtual uint32_t GetPartitionCount(RuntimeIO *) const { return 0; }
+
+    /// \brief Returns the number of iterations to run for the given partition.
+    ///
+    virtual uint32_t GetPartitionIterations(RuntimeIO *, uint32_t) const { return 0; }
+
+    /// \brief Returns whether iterations of this procedure may run concurrently.
+    ///
+    /// When a Pipeline::Program is given more than one worker, each stage
+    /// that returns true has its iterations split across the workers, where 
+    /// each worker has its own RuntimeIO. Procedures that keep state between
+    /// iterations should return false to always be run on a single thread.
+    /// Since the outputs of such a procedure come in order, for example the 
+    /// fragments of overlapping primitives from a rasterizer, every stage after 
+    /// it is also run on a single thread, unless it splits them into partitions
+    /// (see GetPartitionCount()). The default is true.
+    virtual bool IsParallel() const { return true; }
+
+    /// \brief Returns whether the procedure commits exactly one output for each iteration.
+    ///
+    /// Indexed draws only reuse the results of a first stage that returns true,
+    /// running it once for each vertex instead of once for each index (see
+    /// Pipeline::Program::SetVertexCacheSize()). Procedures that may commit more or
+    /// fewer outputs than their iterations should return false. The default is true.
+    virtual bool IsOneToOne() const { return true; }
+
 
 };
 
@@ -3,6 +3,7 @@
 
 #include <cstring>
 #include <cstdint>
+#include <vector>
 #include <SoftRaster/Primitives.h>
 
 namespace SoftRaster {
@@ -12,7 +13,7 @@ namespace SoftRaster {
 /// All pixel positions are relative to the top left of
 /// the image and begin at 0. Any raw pixel access will
 /// layout the data in one contiguous array in a fow major 
-/// fashion
+/// fashion. Pixels may be stored differently in the meantime (see Layout).
 class Texture {
   public:
     
@@ -23,15 +24,16 @@ class Texture {
     enum class ColorAddRule {
         None,    ///< Source overwrites destination.
         Alpha,   ///< Source blends with destination accoring to alpha values. This is the default 
-        Additive ///< Source adds to destination for all channels uniformly.
+        Additive ///< Source adds to destination for all channels uniformly, saturating at 255.
     };
 
 
     /// \brief Denotes the rule to be followed when retrieving pixel data
     ///
     enum class SampleRule {
-        Basic,               ///< The pixel nearest to the sample is returned.
-        LinearInterpolation  ///< The pixel returned is blended with bordering pixel colors uniformly.
+        Basic,               ///< The pixel nearest to the sample is returned, from the mipmap level nearest the level of detail.
+        LinearInterpolation, ///< The 4 pixels nearest to the sample are blended by their distance to it (bilinear), within the mipmap level nearest the level of detail.
+        Trilinear            ///< Bilinear samples of the 2 mipmap levels around the level of detail are blended by it. The same as LinearInterpolation without mipmaps.
     };
 
     /// \brief Denotes a data format.
@@ -43,6 +45,18 @@ class Texture {
     };
 
 
+    /// \brief Denotes how pixels are stored.
+    ///
+    enum class Layout {
+        Linear, ///< Rows are stored one after another, as GetData() returns them. This is the default.
+        Tiled   ///< Pixels are stored in blocks of TileSize-by-TileSize, each filling a 64-byte cache line, so that reads near each other in any direction touch few lines. Suits textures that are sampled rotated or scaled down.
+    };
+
+    /// \brief Width and height in pixels of each block of a Tiled texture.
+    ///
+    static const int TileSize = 4;
+
+
     /// \brief Allocates space for the Texture and initializes with the data given, if any.
     ///
     ///@param w_ Width of the image
@@ -64,18 +78,31 @@ class Texture {
     ///
     /// The data is layed out in a linear format and is Width()*Height()*4 bytes in size.
     /// The first byte is the top left pixel and the last byte is the bottom right pixel of the image.
-    /// The data is also editable.
-    inline uint8_t * GetData() {return data;}
+    /// The data is also editable. A Tiled texture is converted back to Layout::Linear first.
+    inline uint8_t * GetData() {
+        if (layout != Layout::Linear) SetLayout(Layout::Linear);
+        return data;
+    }
+
+    /// \brief Changes how pixels are stored, converting the stored pixels.
+    ///
+    /// The layout is not visible through any other function, 
+    /// except in how fast each one is. See Layout.
+    void SetLayout(Layout);
+
+    /// \brief Returns how pixels are stored.
+    ///
+    inline Layout GetLayout() const { return layout; }
 
     /// \brief Resize the Texture allocation, putting old data anchored to the topleft of the image.
     ///
     /// If the new allocation is greater than the old, pixels outside the 
-    /// old texture are undefined.
+    /// old texture are undefined. Mipmaps are removed.
     void Resize(uint16_t newWidth, uint16_t newHeight);
     
     /// \brief Resize without copying old data.
     ///
-    /// Once called, the Texture's pixel data is undefined.
+    /// Once called, the Texture's pixel data is undefined. Mipmaps are removed.
     void ResizeFast(uint16_t newWidth, uint16_t newHeight);
 
     /// \brief Replace old texture data with this data.
@@ -102,20 +129,77 @@ class Texture {
     void PutPixel  (uint16_t x, uint16_t y, const Color * pixel);
     ///\}
 
-    /// \brief Returns the pixel at the given position according to the sampling rule set by SetSampleRule().
+    /// \brief Edits count consecutive pixels of a row, starting at the given position.
+    ///
+    /// pixels holds count 4-byte pixels, which are blended following the set ColorAddRule
+    /// the same as PutPixel() would, but many at a time. If mask is given, pixel i
+    /// is only edited if mask[i] is nonzero. Bounds checking is not done and should be
+    /// handled by the caller.
+    void PutSpan   (uint16_t x, uint16_t y, uint32_t count, const uint8_t * pixels, const uint8_t * mask = nullptr);
+
+    /// \brief Returns the pixel at the given position.
     ///
     /// Bounds checking is not done and should be handled by the caller.
     ///\{
-    void GetPixel  (uint16_t x, uint16_t y, uint8_t * pixel);
-    void GetPixel  (uint16_t x, uint16_t y, Color * pixel);
+    void GetPixel  (uint16_t x, uint16_t y, uint8_t * pixel) const;
+    void GetPixel  (uint16_t x, uint16_t y, Color * pixel) const;
     ///\}
     
-    /// \brief Equivalent to GetPixel() but the position is a normalized amount from 0.f to 1.f. 
+    /// \brief Samples the image at a position given as a normalized amount from 0.f to 1.f, 
+    /// following the rule set by SetSampleRule().
+    ///
+    /// The sampling positions are clamped. The level of detail picks the mipmap level 
+    /// to read from (see GenerateMipmaps()): 0 is the image itself, 1 is half its size, 
+    /// and so on. Without a level of detail, the image itself is sampled.
+    /// For other addressing, or many samples at once, see Sampler.
+    ///\{
+    void SamplePixel(float x, float y, uint8_t * pixel) const;
+    void SamplePixel(float x, float y, Color * pixel) const;
+    void SamplePixel(float x, float y, float lod, uint8_t * pixel) const;
+    void SamplePixel(float x, float y, float lod, Color * pixel) const;
+    ///\}
+
+    /// \brief Returns the level of detail for sampling a pixel that covers
+    /// part of the image.
+    ///
+    /// The arguments are how much the normalized sample position changes from one
+    /// pixel to the next along x (dudx, dvdx) and along y (dudy, dvdy). The level is
+    /// chosen so that one pixel of it spans the larger of the two steps.
+    float GetLod(float dudx, float dvdx, float dudy, float dvdy) const;
+
+    /// \brief Builds the chain of mipmaps used when sampling with a level of detail.
+    ///
+    /// Each level is half the width and height of the one before, rounding down,
+    /// until a 1x1 level. Each of its pixels is the average of the 2x2 pixels it covers.
+    /// Levels are stored with the same Layout as the image. The chain does not follow
+    /// later changes to the image; call again to rebuild it.
+    void GenerateMipmaps();
+
+    /// \brief Sets a mipmap level to the given pixels instead of generating it.
     ///
-    /// The sampling positions are clamped.
+    /// Levels start at 1 and may be set in any order once they exist,
+    /// or added one after the last (GetMipmapCount()). pixels is laid out like GetData() 
+    /// for the size of the level: half the level before, rounded down and at least 1.
+    /// Other levels are ignored.
+    void SetMipmap(uint32_t level, const uint8_t * pixels);
+
+    /// \brief Removes every mipmap level.
+    ///
+    void ClearMipmaps();
+
+    /// \brief Returns the number of levels, counting the image itself as level 0.
+    ///
+    inline uint32_t GetMipmapCount() const { return mipmaps.size() + 1; }
+
+    /// \brief Returns the given level as a Texture owned by this one, 
+    /// or nullptr if there is no such level. Level 0 is this Texture.
     ///\{
-    void SamplePixel(float x, float y, uint8_t * pixel);
-    void SamplePixel(float x, float y, Color * pixel);
+    inline Texture * GetMipmap(uint32_t level) {
+        return !level ? this : level <= mipmaps.size() ? mipmaps[level-1] : nullptr;
+    }
+    inline const Texture * GetMipmap(uint32_t level) const {
+        return !level ? this : level <= mipmaps.size() ? mipmaps[level-1] : nullptr;
+    }
     ///\}
 
     /// \brief Writes a texture to this texture.
@@ -123,8 +207,8 @@ class Texture {
     /// (x, y) mark the top left of where the source image 
     /// will be placed on the destination image. Pixel blending 
     /// follows set ColorAddRule, and pixels outside the destination 
-    /// Texture are thrown out
-    void PutTexture(uint16_t x, uint16_t y, uint16_t maxW, uint16_t maxH, Texture * src);
+    /// Texture or past (maxX, maxY) are thrown out
+    void PutTexture(uint16_t x, uint16_t y, uint16_t maxX, uint16_t maxY, Texture * src);
     
     /// \brief Returns the current stored image in different formats. See Format for details.
     ///
@@ -135,15 +219,28 @@ class Texture {
     /// Any coloring rules are ignored for this operation.
     void Clear(uint8_t * color);
   private:
+    friend class Sampler;
+
+    // Position of a pixel within data, in pixels
+    inline uint32_t Offset(uint16_t x, uint16_t y) const {
+        if (layout == Layout::Linear) return x + y*w;
+        return ((y / TileSize)*tilesX + x / TileSize)*TileSize*TileSize + (y % TileSize)*TileSize + x % TileSize;
+    }
+    uint32_t StorageSize(Layout) const;
+    const uint8_t * ReadRow(uint16_t y, uint8_t * scratch) const;
 
     uint16_t w, h;
     uint8_t * data;
+    Layout layout;
+    uint32_t tilesX;
+    std::vector<Texture*> mipmaps; // levels from 1 on
 
-    typedef uint8_t *(*ColorTransform)(const uint8_t * src, const uint8_t * dest);
-    typedef uint8_t *(*SampleTransform)(uint16_t, uint16_t, Texture*);
+    typedef void (*ColorTransform)(const uint8_t * src, uint8_t * dest);
+    typedef void (*SpanTransform)(const uint8_t * src, uint8_t * dest, uint32_t count, const uint8_t * mask);
 
     ColorTransform       carule;
-    SampleTransform      sarule;
+    SpanTransform        spanrule;
+    SampleRule           sarule;
 };
 }
 
@@ -0,0 +1,117 @@
+#ifndef H_SOFTRASTER_TYPED_PIPELINE_INCLUDED
+#define H_SOFTRASTER_TYPED_PIPELINE_INCLUDED
+
+/* SoftRaster: TypedPipeline
+   Johnathan Corkery, 2015 */
+#include <type_traits>
+#include <vector>
+#include <SoftRaster/Texture.h>
+#include <SoftRaster/CoreProcedures.h>
+
+
+namespace SoftRaster {
+
+/// \brief Base for stages of a TypedPipeline.
+///
+/// A typed stage is much like a StageProcedure, except that its inputs and 
+/// outputs are plain structs known at compile time. Each stage must derive 
+/// from TypedStage and provide an iteration of the form:
+///
+///     template<typename Out>
+///     void operator()(const Input & in, Out & out);
+///
+/// where out.Emit(const Output &) passes a result to the next stage (the 
+/// equivalent of writing and committing) and out.GetFramebuffer() returns 
+/// the target of the draw. The last stage must have an Output of void.
+///
+/// A stage may also hide NewRun(), which is called before each draw.
+///
+template<typename InputT, typename OutputT = void>
+class TypedStage {
+  public:
+    typedef InputT  Input;
+    typedef OutputT Output;
+
+    void NewRun(Texture *) {}
+};
+
+
+
+/// \brief The output of a TypedRasterizer.
+///
+/// Vertices point to the primitive that generated the fragment and 
+/// are only valid during the iteration.
+template<typename UserVertexT>
+struct RasterFragment {
+    Fragment fragment;               ///< The rasterized fragment. See Fragment.
+    const UserVertexT * vertices[3]; ///< The vertices of the source primitive. 
+};
+
+
+
+/// \brief A TypedStage that rasterizes the incoming vertices.
+///
+/// This performs the same work as the stage from CreateRasterizer()
+/// through a PrimitiveRasterizer. UserVertexT must inherit from Vector3.
+///
+template<typename UserVertexT>
+class TypedRasterizer : public TypedStage<UserVertexT, RasterFragment<UserVertexT>> {
+  public:
+    TypedRasterizer(const RasterizerSettings & = RasterizerSettings());
+
+    void NewRun(Texture *);
+
+    template<typename Out>
+    void operator()(const UserVertexT &, Out &);
+
+  private:
+    PrimitiveRasterizer raster;
+    std::vector<Fragment> fragments;
+    UserVertexT src[3];
+    uint32_t count;
+};
+
+
+
+
+namespace TypedPipelineDetail {
+template<typename ... Stages>
+class Chain;
+}
+
+/// \brief A pipeline whose stages are known at compile time.
+///
+/// TypedPipeline is the static equivalent of Pipeline and Pipeline::Program: 
+/// the vertices of a draw are carried through each of Stages in order. 
+/// Because every stage's types are known, slot offsets are resolved by the 
+/// compiler, mismatched stages fail to compile, and each stage's iteration 
+/// is called directly (and can be inlined) rather than through a virtual call
+/// and RuntimeIO.
+///
+/// The first stage must accept UserVertexT and the Output of 
+/// each stage must be the Input of the next. For example:
+///
+///     TypedPipeline<Vertex, MyVertexStage, TypedRasterizer<Vertex>, MyFragmentStage>
+///
+/// Stages are referenced, not copied, so they must outlive the TypedPipeline.
+/// Rendering is done on the calling thread.
+///
+template<typename UserVertexT, typename ... Stages>
+class TypedPipeline {
+  public:
+    TypedPipeline(Stages & ...);
+
+    /// \brief Renders num vertices to the framebuffer.
+    ///
+    void Run(Texture * framebuffer, const UserVertexT * vertices, uint32_t num);
+
+  private:
+    TypedPipelineDetail::Chain<Stages...> chain;
+};
+
+
+}
+#include <SoftRaster/TypedPipelineImpl.hpp>
+
+
+#endif
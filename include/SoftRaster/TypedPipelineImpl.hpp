@@ -0,0 +1,128 @@
+// should never be included in anything except TypedPipeline.h
+
+namespace SoftRaster {
+namespace TypedPipelineDetail {
+
+// Each link of the chain owns a reference to one stage and 
+// the links after it. A link is also what a stage emits into.
+template<typename Stage, typename ... Rest>
+class Chain<Stage, Rest...> {
+  public:
+    typedef typename Stage::Input  Input;
+    typedef typename Stage::Output Output;
+    typedef Chain<Rest...> Next;
+
+    static_assert(std::is_same<Output, typename Next::Input>::value, 
+        "SoftRaster::TypedPipeline: the Output of a stage must match the Input of the stage after it.");
+
+    Chain(Stage & s, Rest & ... rest) :
+        stage(s),
+        next (rest...)
+    {}
+
+    void NewRun(Texture * fb) {
+        framebuffer = fb;
+        stage.NewRun(fb);
+        next.NewRun(fb);
+    }
+
+    inline void operator()(const Input & in) { stage(in, *this); }
+    inline void Emit(const Output & out)     { next(out); }
+    inline Texture * GetFramebuffer() const  { return framebuffer; }
+
+  private:
+    Stage & stage;
+    Next next;
+    Texture * framebuffer;
+};
+
+template<typename Stage>
+class Chain<Stage> {
+  public:
+    typedef typename Stage::Input Input;
+
+    static_assert(std::is_same<typename Stage::Output, void>::value,
+        "SoftRaster::TypedPipeline: the last stage must not return anything.");
+
+    Chain(Stage & s) :
+        stage(s)
+    {}
+
+    void NewRun(Texture * fb) {
+        framebuffer = fb;
+        stage.NewRun(fb);
+    }
+
+    inline void operator()(const Input & in) { stage(in, *this); }
+    inline Texture * GetFramebuffer() const  { return framebuffer; }
+
+  private:
+    Stage & stage;
+    Texture * framebuffer;
+};
+
+}
+
+
+
+
+template<typename UserVertexT, typename ... Stages>
+TypedPipeline<UserVertexT, Stages...>::TypedPipeline(Stages & ... stages) :
+    chain(stages...) {
+
+    static_assert(std::is_same<UserVertexT, typename TypedPipelineDetail::Chain<Stages...>::Input>::value,
+        "SoftRaster::TypedPipeline: the first stage must accept the UserVertexT.");
+}
+
+template<typename UserVertexT, typename ... Stages>
+void TypedPipeline<UserVertexT, Stages...>::Run(
+        Texture * framebuffer, 
+        const UserVertexT * vertices, 
+        uint32_t num) {
+
+    chain.NewRun(framebuffer);
+    for(uint32_t i = 0; i < num; ++i) {
+        chain(vertices[i]);
+    }
+}
+
+
+
+
+template<typename UserVertexT>
+TypedRasterizer<UserVertexT>::TypedRasterizer(const RasterizerSettings & settings) :
+    raster(settings),
+    count (0) {
+
+    static_assert(std::is_base_of<Vector3, UserVertexT>::value, 
+        "SoftRaster::TypedRasterizer: the vertex type must inherit from SoftRaster::Vector3.");
+}
+
+template<typename UserVertexT>
+void TypedRasterizer<UserVertexT>::NewRun(Texture * framebuffer) {
+    raster.Begin(framebuffer);
+    count = 0;
+}
+
+template<typename UserVertexT>
+template<typename Out>
+void TypedRasterizer<UserVertexT>::operator()(const UserVertexT & v, Out & out) {
+    src[count++] = v;
+    if (count < raster.GetVertexCount()) return;
+    count = 0;
+
+    const Vector3 * positions[3] = {&src[0], &src[1], &src[2]};
+    fragments.clear();
+    raster.Rasterize(positions, fragments);
+
+    RasterFragment<UserVertexT> result;
+    result.vertices[0] = &src[0];
+    result.vertices[1] = &src[1];
+    result.vertices[2] = &src[2];
+    for(uint32_t i = 0; i < fragments.size(); ++i) {
+        result.fragment = fragments[i];
+        out.Emit(result);
+    }
+}
+
+}
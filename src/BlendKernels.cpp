@@ -0,0 +1,267 @@
+#include "BlendKernels.h"
+#include <cstring>
+
+// Like the raster kernels, the vector kernels are compiled for their
+// instruction sets on a per-function basis and only used if the CPU reports support.
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+    #define SR_BLEND_KERNELS_X86
+    #include <immintrin.h>
+#endif
+
+using namespace SoftRaster;
+
+
+static void BlendPixel_None    (const uint8_t *, uint8_t *);
+static void BlendPixel_Alpha   (const uint8_t *, uint8_t *);
+static void BlendPixel_Additive(const uint8_t *, uint8_t *);
+
+template<PixelBlend blend>
+static void SpanBlend_Scalar(const uint8_t *, uint8_t *, uint32_t, const uint8_t *);
+#ifdef SR_BLEND_KERNELS_X86
+static void SpanNone_SSE2    (const uint8_t *, uint8_t *, uint32_t, const uint8_t *);
+static void SpanAlpha_SSE2   (const uint8_t *, uint8_t *, uint32_t, const uint8_t *);
+static void SpanAdditive_SSE2(const uint8_t *, uint8_t *, uint32_t, const uint8_t *);
+static void SpanNone_AVX2    (const uint8_t *, uint8_t *, uint32_t, const uint8_t *);
+static void SpanAlpha_AVX2   (const uint8_t *, uint8_t *, uint32_t, const uint8_t *);
+static void SpanAdditive_AVX2(const uint8_t *, uint8_t *, uint32_t, const uint8_t *);
+#endif
+
+
+struct BlendChoice {
+    BlendChoice() {
+        none     = SpanBlend_Scalar<BlendPixel_None>;
+        alpha    = SpanBlend_Scalar<BlendPixel_Alpha>;
+        additive = SpanBlend_Scalar<BlendPixel_Additive>;
+        name = "Scalar";
+      #ifdef SR_BLEND_KERNELS_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            none     = SpanNone_AVX2;
+            alpha    = SpanAlpha_AVX2;
+            additive = SpanAdditive_AVX2;
+            name = "AVX2";
+        } else if (__builtin_cpu_supports("sse2")) {
+            none     = SpanNone_SSE2;
+            alpha    = SpanAlpha_SSE2;
+            additive = SpanAdditive_SSE2;
+            name = "SSE2";
+        }
+      #endif
+    }
+
+    SpanBlend none;
+    SpanBlend alpha;
+    SpanBlend additive;
+    const char * name;
+};
+
+static const BlendChoice & GetChoice() {
+    static BlendChoice choice;
+    return choice;
+}
+
+PixelBlend SoftRaster::GetPixelBlend(Texture::ColorAddRule rule) {
+    switch(rule) {
+      case Texture::ColorAddRule::None:     return BlendPixel_None;
+      case Texture::ColorAddRule::Additive: return BlendPixel_Additive;
+      default:                              return BlendPixel_Alpha;
+    }
+}
+
+SpanBlend SoftRaster::GetSpanBlend(Texture::ColorAddRule rule, bool vectorized) {
+    if (!vectorized) {
+        switch(rule) {
+          case Texture::ColorAddRule::None:     return SpanBlend_Scalar<BlendPixel_None>;
+          case Texture::ColorAddRule::Additive: return SpanBlend_Scalar<BlendPixel_Additive>;
+          default:                              return SpanBlend_Scalar<BlendPixel_Alpha>;
+        }
+    }
+    switch(rule) {
+      case Texture::ColorAddRule::None:     return GetChoice().none;
+      case Texture::ColorAddRule::Additive: return GetChoice().additive;
+      default:                              return GetChoice().alpha;
+    }
+}
+
+const char * SoftRaster::GetSpanBlendName() {
+    return GetChoice().name;
+}
+
+
+
+
+///// Statics//////
+// Alpha blending is done in integers: each channel becomes
+// (dest*(255-alpha) + src*alpha) / 255, rounded to nearest. With t as the
+// numerator plus 128, (t + (t >> 8)) >> 8 gives that rounding without a divide,
+// and t fits in 16 bits, which lets the vector kernels stay in 16-bit lanes.
+static inline uint8_t Mix(uint32_t src, uint32_t dest, uint32_t alpha) {
+    uint32_t t = dest*(UINT8_MAX - alpha) + src*alpha + 128;
+    return (t + (t >> 8)) >> 8;
+}
+
+void BlendPixel_None(const uint8_t * src, uint8_t * dest) {
+    memcpy(dest, src, 4);
+}
+
+void BlendPixel_Alpha(const uint8_t * src, uint8_t * dest) {
+    uint32_t alpha = src[3];
+    dest[0] = Mix(src[0], dest[0], alpha);
+    dest[1] = Mix(src[1], dest[1], alpha);
+    dest[2] = Mix(src[2], dest[2], alpha);
+    dest[3] = Mix(src[3], dest[3], alpha);
+}
+
+// Channels saturate rather than wrap around
+void BlendPixel_Additive(const uint8_t * src, uint8_t * dest) {
+    for(uint32_t i = 0; i < 4; ++i) {
+        uint32_t sum = src[i] + dest[i];
+        dest[i] = sum > UINT8_MAX ? UINT8_MAX : sum;
+    }
+}
+
+template<PixelBlend blend>
+void SpanBlend_Scalar(const uint8_t * src, uint8_t * dest, uint32_t count, const uint8_t * mask) {
+    for(uint32_t i = 0; i < count; ++i) {
+        if (!mask || mask[i]) blend(src + 4*i, dest + 4*i);
+    }
+}
+
+
+
+
+#ifdef SR_BLEND_KERNELS_X86
+
+// Vector kernels blend as many whole vectors of pixels as fit,
+// then leave the remaining pixels to the scalar kernel.
+
+// Mix() for two pixels widened to 16-bit channels
+__attribute__((target("sse2")))
+static inline __m128i Mix_SSE2(__m128i src, __m128i dest) {
+    __m128i alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(src, 0xFF), 0xFF);
+    __m128i inv = _mm_sub_epi16(_mm_set1_epi16(UINT8_MAX), alpha);
+    __m128i t = _mm_add_epi16(_mm_add_epi16(
+        _mm_mullo_epi16(dest, inv),
+        _mm_mullo_epi16(src, alpha)),
+        _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+// Keeps the destination for pixels of 4 whose mask is 0
+__attribute__((target("sse2")))
+static inline __m128i Select_SSE2(__m128i blended, __m128i dest, const uint8_t * mask) {
+    if (!mask) return blended;
+    int32_t bits;
+    memcpy(&bits, mask, sizeof(int32_t));
+    __m128i m = _mm_cvtsi32_si128(bits);
+    m = _mm_unpacklo_epi8(m, m);
+    m = _mm_unpacklo_epi16(m, m);
+    __m128i keep = _mm_cmpeq_epi8(m, _mm_setzero_si128());
+    return _mm_or_si128(_mm_and_si128(keep, dest), _mm_andnot_si128(keep, blended));
+}
+
+__attribute__((target("sse2")))
+void SpanNone_SSE2(const uint8_t * src, uint8_t * dest, uint32_t count, const uint8_t * mask) {
+    if (!mask) {
+        memcpy(dest, src, count*4);
+        return;
+    }
+    uint32_t i = 0;
+    for(; i + 4 <= count; i += 4) {
+        __m128i s = _mm_loadu_si128((const __m128i*)(src + 4*i));
+        __m128i d = _mm_loadu_si128((const __m128i*)(dest + 4*i));
+        _mm_storeu_si128((__m128i*)(dest + 4*i), Select_SSE2(s, d, mask + i));
+    }
+    SpanBlend_Scalar<BlendPixel_None>(src + 4*i, dest + 4*i, count - i, mask + i);
+}
+
+__attribute__((target("sse2")))
+void SpanAlpha_SSE2(const uint8_t * src, uint8_t * dest, uint32_t count, const uint8_t * mask) {
+    const __m128i zero = _mm_setzero_si128();
+    uint32_t i = 0;
+    for(; i + 4 <= count; i += 4) {
+        __m128i s = _mm_loadu_si128((const __m128i*)(src + 4*i));
+        __m128i d = _mm_loadu_si128((const __m128i*)(dest + 4*i));
+        __m128i lo = Mix_SSE2(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero));
+        __m128i hi = Mix_SSE2(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero));
+        _mm_storeu_si128((__m128i*)(dest + 4*i), Select_SSE2(_mm_packus_epi16(lo, hi), d, mask ? mask + i : nullptr));
+    }
+    SpanBlend_Scalar<BlendPixel_Alpha>(src + 4*i, dest + 4*i, count - i, mask ? mask + i : nullptr);
+}
+
+__attribute__((target("sse2")))
+void SpanAdditive_SSE2(const uint8_t * src, uint8_t * dest, uint32_t count, const uint8_t * mask) {
+    uint32_t i = 0;
+    for(; i + 4 <= count; i += 4) {
+        __m128i s = _mm_loadu_si128((const __m128i*)(src + 4*i));
+        __m128i d = _mm_loadu_si128((const __m128i*)(dest + 4*i));
+        _mm_storeu_si128((__m128i*)(dest + 4*i), Select_SSE2(_mm_adds_epu8(s, d), d, mask ? mask + i : nullptr));
+    }
+    SpanBlend_Scalar<BlendPixel_Additive>(src + 4*i, dest + 4*i, count - i, mask ? mask + i : nullptr);
+}
+
+
+
+// Unpacking and packing work within each 128-bit half, so
+// the AVX2 kernels keep pixels in order the same way.
+__attribute__((target("avx2")))
+static inline __m256i Mix_AVX2(__m256i src, __m256i dest) {
+    __m256i alpha = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(src, 0xFF), 0xFF);
+    __m256i inv = _mm256_sub_epi16(_mm256_set1_epi16(UINT8_MAX), alpha);
+    __m256i t = _mm256_add_epi16(_mm256_add_epi16(
+        _mm256_mullo_epi16(dest, inv),
+        _mm256_mullo_epi16(src, alpha)),
+        _mm256_set1_epi16(128));
+    return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+}
+
+// Keeps the destination for pixels of 8 whose mask is 0
+__attribute__((target("avx2")))
+static inline __m256i Select_AVX2(__m256i blended, __m256i dest, const uint8_t * mask) {
+    if (!mask) return blended;
+    __m256i m = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)mask));
+    __m256i keep = _mm256_cmpeq_epi32(m, _mm256_setzero_si256());
+    return _mm256_blendv_epi8(blended, dest, keep);
+}
+
+__attribute__((target("avx2")))
+void SpanNone_AVX2(const uint8_t * src, uint8_t * dest, uint32_t count, const uint8_t * mask) {
+    if (!mask) {
+        memcpy(dest, src, count*4);
+        return;
+    }
+    uint32_t i = 0;
+    for(; i + 8 <= count; i += 8) {
+        __m256i s = _mm256_loadu_si256((const __m256i*)(src + 4*i));
+        __m256i d = _mm256_loadu_si256((const __m256i*)(dest + 4*i));
+        _mm256_storeu_si256((__m256i*)(dest + 4*i), Select_AVX2(s, d, mask + i));
+    }
+    SpanBlend_Scalar<BlendPixel_None>(src + 4*i, dest + 4*i, count - i, mask + i);
+}
+
+__attribute__((target("avx2")))
+void SpanAlpha_AVX2(const uint8_t * src, uint8_t * dest, uint32_t count, const uint8_t * mask) {
+    const __m256i zero = _mm256_setzero_si256();
+    uint32_t i = 0;
+    for(; i + 8 <= count; i += 8) {
+        __m256i s = _mm256_loadu_si256((const __m256i*)(src + 4*i));
+        __m256i d = _mm256_loadu_si256((const __m256i*)(dest + 4*i));
+        __m256i lo = Mix_AVX2(_mm256_unpacklo_epi8(s, zero), _mm256_unpacklo_epi8(d, zero));
+        __m256i hi = Mix_AVX2(_mm256_unpackhi_epi8(s, zero), _mm256_unpackhi_epi8(d, zero));
+        _mm256_storeu_si256((__m256i*)(dest + 4*i), Select_AVX2(_mm256_packus_epi16(lo, hi), d, mask ? mask + i : nullptr));
+    }
+    SpanBlend_Scalar<BlendPixel_Alpha>(src + 4*i, dest + 4*i, count - i, mask ? mask + i : nullptr);
+}
+
+__attribute__((target("avx2")))
+void SpanAdditive_AVX2(const uint8_t * src, uint8_t * dest, uint32_t count, const uint8_t * mask) {
+    uint32_t i = 0;
+    for(; i + 8 <= count; i += 8) {
+        __m256i s = _mm256_loadu_si256((const __m256i*)(src + 4*i));
+        __m256i d = _mm256_loadu_si256((const __m256i*)(dest + 4*i));
+        _mm256_storeu_si256((__m256i*)(dest + 4*i), Select_AVX2(_mm256_adds_epu8(s, d), d, mask ? mask + i : nullptr));
+    }
+    SpanBlend_Scalar<BlendPixel_Additive>(src + 4*i, dest + 4*i, count - i, mask ? mask + i : nullptr);
+}
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef H_SOFTRASTER_BLEND_KERNELS_INCLUDED
+#define H_SOFTRASTER_BLEND_KERNELS_INCLUDED
+
+/* SoftRaster: BlendKernels (internal)
+   Johnathan Corkery, 2015 */
+#include <cstdint>
+#include <SoftRaster/Texture.h>
+
+namespace SoftRaster {
+
+// Blends one 4-byte source pixel into the destination pixel in place.
+typedef void (*PixelBlend)(const uint8_t * src, uint8_t * dest);
+
+// Blends count consecutive source pixels into as many destination pixels.
+// If mask is given, pixel i is only blended if mask[i] is nonzero.
+//
+// Every kernel gives the same results as blending each pixel
+// with the PixelBlend of the same rule, bit for bit.
+typedef void (*SpanBlend)(const uint8_t * src, uint8_t * dest, uint32_t count, const uint8_t * mask);
+
+
+// Returns the per-pixel blend of the rule.
+PixelBlend GetPixelBlend(Texture::ColorAddRule);
+
+// Returns the span blend of the rule using the widest instruction
+// set supported by the running CPU, or the scalar one if not vectorized.
+SpanBlend GetSpanBlend(Texture::ColorAddRule, bool vectorized);
+
+// Returns the name of the instruction set used by GetSpanBlend(rule, true).
+const char * GetSpanBlendName();
+
+}
+
+#endif
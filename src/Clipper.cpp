@@ -0,0 +1,318 @@
+#include <SoftRaster/CoreProcedures.h>
+#include "PrimitiveAssembly.h"
+#include <algorithm>
+#include <cstring>
+
+using namespace SoftRaster;
+
+
+// Planes are kept where their distance is non-negative: the depth planes
+// z = -w and z = w, w > 0, then the four sides of the guard band.
+const uint32_t clipper_num_planes = 7;
+
+// Most vertices a triangle can have once clipped by every plane
+const uint32_t clipper_max_vertices = 3 + clipper_num_planes;
+
+// Smallest w kept when clipping in homogeneous space
+const float clipper_min_w = 1e-5f;
+
+enum ClipperCount {
+    Count_Primitives,
+    Count_Outside,
+    Count_Culled,
+    Count_ZeroArea,
+    Count_Clipped,
+    Count_Emitted
+};
+
+
+// Working data of a Clipper for a single Program.
+class ClipperState : public StageState {
+  public:
+    ClipperState() {
+        sizeofVertex = 0;
+    }
+
+    // vertices held for the next primitives, in 3 slots
+    std::vector<uint8_t> assembled;
+    PrimitiveAssembly assembly;
+
+    // polygon being clipped, and the result of clipping it by the next plane
+    std::vector<uint8_t> polygon[2];
+    uint32_t sizeofVertex;
+};
+
+
+static float PositionW(const uint8_t * vertex, int32_t wOffset);
+static void  PlaneDistances(const uint8_t * vertex, const ClipperSettings &, float * out);
+static bool  Outside(const uint8_t * const * vertices, uint32_t count, int32_t wOffset);
+static void  Divide(uint8_t * vertex, int32_t wOffset);
+static void  Lerp(uint8_t * out, const uint8_t * a, const uint8_t * b, float t, uint32_t sizeofVertex);
+
+
+
+
+
+
+
+Clipper::Clipper(const ClipperSettings & s) {
+    settings = s;
+    switch(settings.shape) {
+      case Polygon::Triangles: vertexCount = 3; break;
+      case Polygon::Lines:     vertexCount = 2; break;
+      case Polygon::Points:    vertexCount = 1; break;
+    }
+    ResetStatistics();
+}
+
+Clipper::Statistics Clipper::GetStatistics() const {
+    Statistics out;
+    out.primitives = counts[Count_Primitives];
+    out.outside    = counts[Count_Outside];
+    out.culled     = counts[Count_Culled];
+    out.zeroArea   = counts[Count_ZeroArea];
+    out.clipped    = counts[Count_Clipped];
+    out.emitted    = counts[Count_Emitted];
+    return out;
+}
+
+void Clipper::ResetStatistics() {
+    for(uint32_t i = 0; i < 6; ++i) {
+        counts[i] = 0;
+    }
+}
+
+float Clipper::Statistics::GetRemovedRate() const {
+    if (!primitives) return 0.f;
+    return (outside + culled + zeroArea) / (float)primitives;
+}
+
+
+
+StageProcedure::SignatureIO Clipper::InputSignature() const {
+    SignatureIO input;
+    input.AddSlot(DataType::UserVertex);
+    return input;
+}
+
+StageProcedure::SignatureIO Clipper::OutputSignature() const {
+    SignatureIO output;
+    output.AddSlot(DataType::UserVertex);
+    return output;
+}
+
+StageState * Clipper::CreateState() const {
+    return new ClipperState;
+}
+
+void Clipper::NewRun(RuntimeIO * io) {
+    ClipperState * state = (ClipperState*)io->GetState();
+    state->assembly = PrimitiveAssembly(settings.topology, vertexCount);
+    state->sizeofVertex = io->SizeOf(DataType::UserVertex);
+    state->assembled.resize(3 * state->sizeofVertex);
+    state->polygon[0].resize(clipper_max_vertices * state->sizeofVertex);
+    state->polygon[1].resize(clipper_max_vertices * state->sizeofVertex);
+}
+
+
+void Clipper::operator()(RuntimeIO * io) {
+    ClipperState * state = (ClipperState*)io->GetState();
+    uint32_t sizeofVertex = state->sizeofVertex;
+    if (io->IsRestart(io->GetCurrentIteration())) state->assembly.Restart();
+    uint32_t slot = state->assembly.FreeSlot();
+    memcpy(&state->assembled[slot * sizeofVertex], io->GetReadPointer(), sizeofVertex);
+
+    uint32_t slots[3];
+    if (!state->assembly.Add(slot, slots)) return;
+    counts[Count_Primitives].fetch_add(1, std::memory_order_relaxed);
+
+
+    const uint8_t * vertices[3];
+    for(uint32_t i = 0; i < vertexCount; ++i) {
+        vertices[i] = &state->assembled[slots[i] * sizeofVertex];
+    }
+    if (Outside(vertices, vertexCount, settings.wOffset)) {
+        counts[Count_Outside].fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+
+    // Lines are cut to the part inside every plane (Liang-Barsky), 
+    // and points outside any plane are removed
+    if (vertexCount < 3) {
+        float d[2][clipper_num_planes];
+        float t[2] = {0.f, 1.f};
+        for(uint32_t i = 0; i < vertexCount; ++i) {
+            PlaneDistances(vertices[i], settings, d[i]);
+        }
+        for(uint32_t n = 0; n < clipper_num_planes; ++n) {
+            float da = d[0][n];
+            float db = d[vertexCount-1][n];
+            if (da < 0.f && db < 0.f) {
+                t[0] = 1.f;
+                t[1] = 0.f;
+                break;
+            }
+            if (da < 0.f) t[0] = std::max(t[0], da / (da - db));
+            if (db < 0.f) t[1] = std::min(t[1], da / (da - db));
+        }
+        if (t[0] > t[1]) {
+            counts[Count_Outside].fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        if (t[0] > 0.f || t[1] < 1.f) counts[Count_Clipped].fetch_add(1, std::memory_order_relaxed);
+
+        // endpoints that were not cut are kept exactly
+        for(uint32_t i = 0; i < vertexCount; ++i) {
+            if (t[i] == (float)i) memcpy(io->GetWritePointer(), vertices[i], sizeofVertex);
+            else                  Lerp(io->GetWritePointer(), vertices[0], vertices[1], t[i], sizeofVertex);
+            Divide(io->GetWritePointer(), settings.wOffset);
+            io->Commit();
+        }
+        counts[Count_Emitted].fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+
+
+    // Clip the triangle by each plane it crosses (Sutherland-Hodgman)
+    uint8_t * polygon = &state->polygon[0][0];
+    uint8_t * next    = &state->polygon[1][0];
+    uint32_t count = 3;
+    for(uint32_t i = 0; i < 3; ++i) {
+        memcpy(polygon + i*sizeofVertex, vertices[i], sizeofVertex);
+    }
+
+    float distances[clipper_max_vertices][clipper_num_planes];
+    uint32_t crossed = 0;
+    for(uint32_t i = 0; i < 3; ++i) {
+        PlaneDistances(polygon + i*sizeofVertex, settings, distances[i]);
+        for(uint32_t n = 0; n < clipper_num_planes; ++n) {
+            if (distances[i][n] < 0.f) crossed |= 1 << n;
+        }
+    }
+    if (crossed) counts[Count_Clipped].fetch_add(1, std::memory_order_relaxed);
+
+    for(uint32_t plane = 0; plane < clipper_num_planes && count; ++plane) {
+        if (!(crossed & (1 << plane))) continue;
+
+        // distances change as vertices are made, so they are found again for each plane
+        uint32_t nextCount = 0;
+        for(uint32_t i = 0; i < count; ++i) {
+            const uint8_t * a = polygon + i*sizeofVertex;
+            const uint8_t * b = polygon + ((i+1)%count)*sizeofVertex;
+            float da[clipper_num_planes];
+            float db[clipper_num_planes];
+            PlaneDistances(a, settings, da);
+            PlaneDistances(b, settings, db);
+
+            if (da[plane] >= 0.f) {
+                memcpy(next + nextCount++*sizeofVertex, a, sizeofVertex);
+            }
+            if ((da[plane] >= 0.f) != (db[plane] >= 0.f)) {
+                Lerp(next + nextCount++*sizeofVertex, a, b, da[plane] / (da[plane] - db[plane]), sizeofVertex);
+            }
+        }
+        std::swap(polygon, next);
+        count = nextCount;
+    }
+    if (count < 3) {
+        counts[Count_Outside].fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+
+    // Cull by the winding and area of what is left on screen
+    for(uint32_t i = 0; i < count; ++i) {
+        Divide(polygon + i*sizeofVertex, settings.wOffset);
+    }
+    float area = 0.f;
+    for(uint32_t i = 0; i < count; ++i) {
+        const Vector3 * a = (Vector3*)(polygon + i*sizeofVertex);
+        const Vector3 * b = (Vector3*)(polygon + ((i+1)%count)*sizeofVertex);
+        area += a->x*b->y - b->x*a->y;
+    }
+    if (area == 0.f) {
+        if (settings.cullZeroArea) {
+            counts[Count_ZeroArea].fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+    } else {
+        bool front = settings.clockwiseFront ? area < 0.f : area > 0.f;
+        if ((settings.cull == CullFace::Back  && !front) ||
+            (settings.cull == CullFace::Front &&  front)) {
+            counts[Count_Culled].fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+    }
+
+
+    // Clipped polygons are convex, so they are passed on as a fan
+    for(uint32_t i = 1; i+1 < count; ++i) {
+        uint32_t fan[3] = {0, i, i+1};
+        for(uint32_t n = 0; n < 3; ++n) {
+            memcpy(io->GetWritePointer(), polygon + fan[n]*sizeofVertex, sizeofVertex);
+            io->Commit();
+        }
+        counts[Count_Emitted].fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+
+
+
+
+///// Statics//////
+float PositionW(const uint8_t * vertex, int32_t wOffset) {
+    return wOffset < 0 ? 1.f : *(const float*)(vertex + wOffset);
+}
+
+void PlaneDistances(const uint8_t * vertex, const ClipperSettings & settings, float * out) {
+    const Vector3 * p = (const Vector3*)vertex;
+    float w = PositionW(vertex, settings.wOffset);
+    float band = w * settings.guardBand;
+    out[0] = w + p->z;
+    out[1] = w - p->z;
+    out[2] = settings.wOffset < 0 ? 1.f : w - clipper_min_w;
+    out[3] = band + p->x;
+    out[4] = band - p->x;
+    out[5] = band + p->y;
+    out[6] = band - p->y;
+}
+
+// Whether all vertices are on the outer side of the same side of the view volume
+bool Outside(const uint8_t * const * vertices, uint32_t count, int32_t wOffset) {
+    uint32_t outside = 0x7f;
+    for(uint32_t i = 0; i < count; ++i) {
+        const Vector3 * p = (const Vector3*)vertices[i];
+        float w = PositionW(vertices[i], wOffset);
+        uint32_t flags = 0;
+        if (p->x < -w) flags |= 1;
+        if (p->x >  w) flags |= 2;
+        if (p->y < -w) flags |= 4;
+        if (p->y >  w) flags |= 8;
+        if (p->z < -w) flags |= 16;
+        if (p->z >  w) flags |= 32;
+        if (w <= 0.f)  flags |= 64;
+        outside &= flags;
+    }
+    return outside != 0;
+}
+
+void Divide(uint8_t * vertex, int32_t wOffset) {
+    if (wOffset < 0) return;
+    Vector3 * p = (Vector3*)vertex;
+    float w = PositionW(vertex, wOffset);
+    p->x /= w;
+    p->y /= w;
+    p->z /= w;
+}
+
+void Lerp(uint8_t * out, const uint8_t * a, const uint8_t * b, float t, uint32_t sizeofVertex) {
+    const float * fa = (const float*)a;
+    const float * fb = (const float*)b;
+    float * fo = (float*)out;
+    for(uint32_t i = 0; i < sizeofVertex / sizeof(float); ++i) {
+        fo[i] = fa[i] + (fb[i] - fa[i]) * t;
+    }
+}
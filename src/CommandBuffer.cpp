@@ -0,0 +1,175 @@
+#include <SoftRaster/CommandBuffer.h>
+#include <algorithm>
+#include <cstring>
+
+using namespace SoftRaster;
+
+
+// Recorded data is kept at offsets aligned for any type,
+// since instance data is read in place.
+static const uint32_t data_alignment = 16;
+
+static uint32_t FirstUse(std::vector<const void *> & seen, const void * a, const void * b);
+
+
+CommandBuffer::CommandBuffer() :
+          framebuffer (nullptr),
+          depth       (nullptr),
+          program     (nullptr),
+          planned     (true) {
+}
+
+
+void CommandBuffer::SetFramebuffer(Texture * t) {
+    framebuffer = t;
+}
+
+void CommandBuffer::SetDepthBuffer(DepthBuffer * d) {
+    depth = d;
+}
+
+void CommandBuffer::UseProgram(Pipeline::Program * p) {
+    program = p;
+}
+
+void CommandBuffer::Clear() {
+    draws.clear();
+    data.clear();
+    indexData.clear();
+    order.clear();
+    batches.clear();
+    planned = true;
+}
+
+uint32_t CommandBuffer::GetDrawCount() const {
+    return draws.size();
+}
+
+uint32_t CommandBuffer::GetRunCount() const {
+    Plan();
+    return batches.size();
+}
+
+
+
+void CommandBuffer::Record(
+        DrawKind kind,
+        const uint8_t * v,
+        uint32_t sizeofVertex,
+        uint32_t num,
+        const uint32_t * indices,
+        uint32_t numIndices,
+        const uint8_t * instanceData,
+        uint32_t sizeofInstance,
+        uint32_t numInstances) {
+
+    if (!program) return;
+    Draw draw;
+    draw.kind = kind;
+    draw.program = program;
+    draw.framebuffer = framebuffer;
+    draw.depth = depth;
+    draw.sizeofVertex = sizeofVertex;
+    draw.num = num;
+    draw.vertices = Store(v, num*sizeofVertex);
+    draw.numIndices = numIndices;
+    draw.indices = indexData.size();
+    indexData.insert(indexData.end(), indices, indices + numIndices);
+    draw.sizeofInstance = sizeofInstance;
+    draw.numInstances = numInstances;
+    draw.instances = Store(instanceData, numInstances*sizeofInstance);
+
+    draws.push_back(draw);
+    planned = false;
+}
+
+uint32_t CommandBuffer::Store(const uint8_t * src, uint32_t size) {
+    uint32_t offset = (data.size() + data_alignment - 1) / data_alignment * data_alignment;
+    data.resize(offset + size);
+    if (size) memcpy(&data[offset], src, size);
+    return offset;
+}
+
+// Whether b may run as part of the same program run as a, right after it.
+// Without a depth buffer, rasterizers clear their own at the start of each run,
+// so each draw needs a run of its own to be depth tested only against itself.
+bool CommandBuffer::Merges(const Draw & a, const Draw & b) const {
+    return a.kind == b.kind &&
+           a.kind != DrawKind::Instanced &&
+           a.program == b.program &&
+           a.framebuffer == b.framebuffer &&
+           a.depth == b.depth &&
+           a.depth != nullptr &&
+           a.sizeofVertex == b.sizeofVertex;
+}
+
+// Orders the draws by the first use of their program, then of their
+// framebuffer and depth buffer, and merges what runs together.
+void CommandBuffer::Plan() const {
+    if (planned) return;
+    planned = true;
+
+    std::vector<const void *> programs;
+    std::vector<const void *> targets;
+    std::vector<uint64_t> keys(draws.size());
+    for(uint32_t i = 0; i < draws.size(); ++i) {
+        uint64_t p = FirstUse(programs, draws[i].program, nullptr);
+        uint64_t t = FirstUse(targets, draws[i].framebuffer, draws[i].depth);
+        keys[i] = (p << 32) | t;
+    }
+    order.resize(draws.size());
+    for(uint32_t i = 0; i < order.size(); ++i) order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&keys](uint32_t a, uint32_t b) {
+        return keys[a] < keys[b];
+    });
+
+
+    batches.clear();
+    for(uint32_t i = 0; i < order.size();) {
+        uint32_t count = 1;
+        while(i + count < order.size() && Merges(draws[order[i]], draws[order[i+count]]))
+            count++;
+
+        batches.push_back(Batch());
+        Batch & batch = batches.back();
+        batch.first = i;
+        batch.count = count;
+        i += count;
+        if (count == 1) continue;
+
+        // merged indices restart between draws, so that each
+        // draw's strips and fans start over like they would alone
+        uint32_t num = 0;
+        for(uint32_t n = batch.first; n < i; ++n) {
+            const Draw & draw = draws[order[n]];
+            if (n != batch.first) {
+                if (draw.kind == DrawKind::Indexed) batch.indices.push_back(Pipeline::Program::RestartIndex);
+                else                                batch.starts.push_back(num);
+            }
+            batch.vertices.insert(
+                batch.vertices.end(),
+                data.begin() + draw.vertices,
+                data.begin() + draw.vertices + draw.num*draw.sizeofVertex
+            );
+            for(uint32_t k = 0; k < draw.numIndices; ++k) {
+                uint32_t index = indexData[draw.indices + k];
+                batch.indices.push_back(index == Pipeline::Program::RestartIndex ? index : index + num);
+            }
+            num += draw.num;
+        }
+    }
+}
+
+
+
+
+///// Statics//////
+// Returns the order in which the pair was first seen, adding it if new
+uint32_t FirstUse(std::vector<const void *> & seen, const void * a, const void * b) {
+    for(uint32_t i = 0; i < seen.size(); i += 2) {
+        if (seen[i] == a && seen[i+1] == b) return i / 2;
+    }
+    seen.push_back(a);
+    seen.push_back(b);
+    return seen.size() / 2 - 1;
+}
@@ -3,6 +3,7 @@
 using namespace SoftRaster;
 
 Context::Context(Texture * dfb) :
+          depth        (nullptr),
           program      (nullptr){
     SetFramebuffer(dfb);
 }
@@ -12,6 +13,53 @@ void Context::SetFramebuffer(Texture * t) {
     framebuffer = t;
 }
 
+void Context::SetDepthBuffer(DepthBuffer * d) {
+    depth = d;
+}
+
 void Context::UseProgram(Pipeline::Program * p) {
     program = p;
 }
+
+void Context::Submit(const CommandBuffer & buffer) {
+    typedef CommandBuffer::DrawKind DrawKind;
+    buffer.Plan();
+    uint8_t * data = (uint8_t*)buffer.data.data();
+
+    for(uint32_t i = 0; i < buffer.batches.size(); ++i) {
+        const CommandBuffer::Batch & batch = buffer.batches[i];
+        const CommandBuffer::Draw & draw = buffer.draws[buffer.order[batch.first]];
+
+        if (batch.count > 1) {
+            uint8_t * v = (uint8_t*)batch.vertices.data();
+            if (draw.kind == DrawKind::Indexed) {
+                draw.program->RunIndexed(draw.framebuffer, draw.depth, v, draw.sizeofVertex, batch.indices.data(), batch.indices.size(), true);
+            } else {
+                draw.program->Run(
+                    draw.framebuffer, 
+                    draw.depth, 
+                    v, 
+                    draw.sizeofVertex, 
+                    batch.vertices.size() / draw.sizeofVertex, 
+                    batch.starts.data(), 
+                    batch.starts.size()
+                );
+            }
+            continue;
+        }
+
+        switch(draw.kind) {
+          case DrawKind::Vertices:
+            draw.program->Run(draw.framebuffer, draw.depth, data + draw.vertices, draw.sizeofVertex, draw.num);
+            break;
+          case DrawKind::Indexed:
+            draw.program->RunIndexed(draw.framebuffer, draw.depth, data + draw.vertices, draw.sizeofVertex, 
+                                     buffer.indexData.data() + draw.indices, draw.numIndices);
+            break;
+          case DrawKind::Instanced:
+            draw.program->RunInstanced(draw.framebuffer, draw.depth, data + draw.vertices, draw.sizeofVertex, draw.num,
+                                       data + draw.instances, draw.sizeofInstance, draw.numInstances);
+            break;
+        }
+    }
+}
@@ -1,5 +1,9 @@
 #include <SoftRaster/CoreProcedures.h>
+#include "RasterKernels.h"
+#include "PrimitiveAssembly.h"
 #include <algorithm>
+#include <cassert>
+#include <cmath>
 using namespace SoftRaster;
 
 
@@ -41,8 +45,8 @@ class BarycentricTransform {
 
     
     // converts xy into "biases" towards each vertex
-    void Transform(int x, int y, float * b0, float * b1, float * b2) {
-        static float inVec[2];
+    void Transform(int x, int y, float * b0, float * b1, float * b2) const {
+        float inVec[2];
         inVec[0] = x - cartV2x;
         inVec[1] = y - cartV2y;
 
@@ -67,111 +71,223 @@ class BarycentricTransform {
 };
     
 
-class DepthBuffer {
-  public:
-    virtual void Reset(uint16_t, uint16_t) = 0;
-    virtual bool Test(uint16_t, uint16_t, float) = 0;
-
-};
+// The built in stages are a little strange
+// because they will often need to pass information that they don't use
+//
+//
+//
 
 
-class DepthBuffer8Bit : public DepthBuffer {
+// Working data of a rasterizer for a single Program.
+class RasterizerState : public StageState {
   public:
-    DepthBuffer8Bit() {
-        data = nullptr;
-        numUnits = 0;
-        w = 0;
-        h = 0;
-    }
-    void Reset(uint16_t fbW, uint16_t fbH) {
-        w = fbW;
-        h = fbH;
-        if (numUnits < fbW * fbH) {
-            numUnits = fbW * fbH;
-            data = (uint8_t*)realloc(data, numUnits);
-        }
-        memset(data, 0, numUnits);        
-    }
-    bool Test(uint16_t x, uint16_t y, float homogenousZ) {
-        if (homogenousZ < -1.f || homogenousZ > 1.f) return false;
-        uint8_t val = (homogenousZ = (homogenousZ+1.f)/2.f) * UINT8_MAX;
-        if (val > data[x + y*w]) {
-            data[x + y*w] = val;
-            return true;
+    RasterizerState(DepthBuffer * d) {
+        srcV[0] = nullptr;
+        srcV[1] = nullptr;
+        srcV[2] = nullptr;
+        srcVSize = 0;
+        binsX = 0;
+        binsY = 0;
+        binned = false;
+        depth = d;
+        target = nullptr;
+        primitiveSize = 0;
+    }
+
+    ~RasterizerState() {
+        for(uint32_t i = 0; i < 3; ++i) {
+            delete[] srcV[i];
         }
-        return false;
+        delete depth;
     }
-    
-  private:
-    uint8_t * data;
-    uint16_t w;
-    uint16_t h;
-    uint32_t numUnits;
+
+    int framebufferW;
+    int framebufferH;    
+
+    // vertices held for the next primitives when not binning, 
+    // so that they outlive the input they came from
+    uint8_t * srcV[3];
+    uint32_t srcVSize;
+    PrimitiveAssembly assembly;
+
+    // binning. The vertices of each primitive are given as iterations.
+    uint32_t binsX;
+    uint32_t binsY;
+    std::vector<uint32_t> assembled;
+    std::vector<std::vector<uint32_t>> bins;
+    std::vector<uint32_t> activeBins;
+    bool binned;
+
+    // the rasterizer's own depth buffer, and the one used by this draw
+    DepthBuffer * depth;
+    DepthBuffer * target;
+
+    // vertices of each primitive of the draw, when passing on primitive IDs
+    std::vector<uint8_t> primitives;
+    uint32_t primitiveSize;
 };
 
 
+// Rows with a span open at once. Must be at least the 
+// height of a block of the edge function rasterizer.
+const uint32_t span_rows = 8;
 
-// The built in stages are a little strange
-// because they will often need to pass information that they don't use
-//
-//
-//
+
+// Everything needed to rasterize a single primitive.
+// Lives on the stack so that separate bins can be 
+// rasterized at the same time.
+struct Primitive {
+    RuntimeIO * io;
+    RasterizerState * state;
+    uint8_t * v[3];
+    float z[3]; // depth of each vertex, or 0 past vertexCount
+
+    // entry in the primitive table, or no_primitive_id until the first fragment is emitted
+    uint32_t id;
+
+    // when set, fragments are collected here rather than committed to io
+    std::vector<Fragment> * out;
+
+    // open span of each row, by row modulo span_rows. Empty when x0 == x1.
+    Span spans[span_rows];
+
+    // float attributes to interpolate for each fragment
+    VaryingPlanes varyings;
+
+    // region of the framebuffer the primitive may write to.
+    // min is inclusive, max is exclusive.
+    int clipXmin;
+    int clipYmin;
+    int clipXmax;
+    int clipYmax;
+};
+
+
+const uint32_t no_primitive_id = UINT32_MAX;
+
+// Assembly handles at or past this are slots of RasterizerState::srcV rather than iterations
+const uint32_t slot_handle = UINT32_MAX - 3;
+
+static bool ClipSegment(float ax, float ay, float bx, float by, float xmin, float ymin, float xmax, float ymax, float & t0, float & t1);
+
+
+// Fixed-point edge functions of a triangle. Edge i is opposite vertex i.
+// Values are at the center of pixel (originX, originY) and already include
+// the fill rule adjustment, so a pixel is covered if all are non-negative.
+struct TriangleEdges {
+    int64_t origin[3];
+    int64_t stepX[3];
+    int64_t stepY[3];
+    int64_t fill[3];
+    int originX;
+    int originY;
+
+    float invArea;
+    bool swapped; // edges 1 and 2 belong to vertices 2 and 1
+};
 
 
 class Rasterizer : public StageProcedure {
   public:
-    Rasterizer(Polygon p, DepthBuffering d);
+    Rasterizer(const RasterizerSettings &);
 
     SignatureIO InputSignature() const;
     SignatureIO OutputSignature() const;
+    StageState * CreateState() const;
 
 
     void operator()(RuntimeIO * io_);
+    void Batch(RuntimeIO *, uint32_t count);
+    void NewRun(RuntimeIO *);
+
+    uint32_t GetPartitionCount(RuntimeIO *) const;
+    uint32_t GetPartitionIterations(RuntimeIO *, uint32_t) const;
+
+    // Vertices are gathered across iterations and 
+    // all primitives share the depth buffer
+    bool IsParallel() const { return false; }
+    bool IsOneToOne() const { return false; }
     
 
   private:
+    friend class SoftRaster::PrimitiveRasterizer;
 
+    // Prepares the state for a new draw to the framebuffer. 
+    // Without a depth buffer given, the rasterizer's own is cleared and used.
+    void Begin(RasterizerState *, Texture *, DepthBuffer *) const;
 
 
-    // sets up the stage for a new set of vertices
-    void NewRun();
 
+    // Rasterizes the primitive and commits its fragments
+    void Render(Primitive &) const;
+
+    // Depth tests the fragment and commits it if it passes. 
+    // With spans, it is instead added to the open span of its row.
+    // If already interpolated, the fragment's varyings are every stride'th float of varyings.
+    void Emit(Primitive &, const Fragment &, const float * varyings = nullptr, uint32_t stride = 0) const;
+
+    // Commits a Fragment or Span along with its varyings (every stride'th float),
+    // followed by the primitive's vertices or ID
+    template<typename T>
+    void Write(Primitive &, const T &, const float * varyings = nullptr, uint32_t stride = 0) const;
+
+    // Prepares the planes of the primitive's varyings
+    void SetupVaryings(Primitive &) const;
 
 
     // Rasterization of the triangle 
     // by testing if fragments lie within the triangle
     // using barycentric coordinates
-    void (*PopulateFragments)(Rasterizer *);
+    void (*PopulateFragments)(const Rasterizer *, Primitive &);
 
-    // returns false if all tris are outside of
-    // clipping space. That is, returns false if
-    // all xyz of each vertex have a magnitude greater than 1
-    bool PassesClipTest();
+    // Returns whether all of the primitive's fragments within the given pixels 
+    // (from the bottom of the framebuffer) are certain to fail the depth test, 
+    // given that their depths are within [minZ, maxZ].
+    bool Occluded(const Primitive &, int x0, int y0, int x1, int y1, float minZ, float maxZ) const;
 
+    // Calculates the pixel bounding box of the primitive within its 
+    // clipping region. Returns false if no pixels could be covered.
+    bool Bounds(const Primitive &, int & xmin, int & ymin, int & xmax, int & ymax) const;
 
-    // impl
-    static void PopulateFragments_Triangles(Rasterizer *);
-    static void PopulateFragments_Lines(Rasterizer *);
-    static void PopulateFragments_Points(Rasterizer *);
+    // Sorts all incoming primitives into screen tiles
+    void Bin(RuntimeIO *, RasterizerState *) const;
 
+    // Rasterizes count single pixel points from the given iteration 
+    // straight into the output
+    void BatchPoints(RuntimeIO *, RasterizerState *, uint32_t first, uint32_t count) const;
 
+    // Copies the primitive's vertices into the primitive table 
+    // and publishes the table to the next stages
+    void AddPrimitive(RuntimeIO *, Primitive &) const;
 
-    
 
+    // impl
+    static void PopulateFragments_Triangles(const Rasterizer *, Primitive &);
+    static void PopulateFragments_TriangleEdges(const Rasterizer *, Primitive &);
+    static void RasterizeBlock(const Rasterizer *, Primitive &, const TriangleEdges &, int x0, int y0, int x1, int y1, bool test);
+    static void PopulateFragments_Lines(const Rasterizer *, Primitive &);
+    static void PopulateFragments_Points(const Rasterizer *, Primitive &);
 
 
-    int framebufferW;
-    int framebufferH;    
 
-    uint8_t * srcV[3];
+    
 
 
 
-    std::vector<Fragment> fragments;
-    RuntimeIO * io;
-    uint8_t count;
     uint8_t vertexCount;
-    DepthBuffer * PassesDepth;
+    Topology topology;
+    uint16_t pointSize;
+    uint16_t binSize;
+    DepthBuffering depthMode;
+    RasterMethod method;
+    RowKernel rowKernel;
+    FragmentFormat format;
+    bool spans;
+    uint32_t varyingOffset;
+    uint32_t varyingCount;
+    int32_t perspectiveOffset;
+    VaryingKernel varyingKernel;      // for rows of pixels
+    VaryingKernel pixelVaryingKernel; // for single pixels
 
 };
 
@@ -183,7 +299,55 @@ class Rasterizer : public StageProcedure {
 
 
 StageProcedure * SoftRaster::CreateRasterizer(Polygon p, DepthBuffering d) {
-    return new Rasterizer(p, d);
+    return new Rasterizer(RasterizerSettings(p, d));
+}
+
+StageProcedure * SoftRaster::CreateRasterizer(const RasterizerSettings & settings) {
+    return new Rasterizer(settings);
+}
+
+
+
+const char * SoftRaster::GetRasterKernelName() {
+    return GetRowKernelName();
+}
+
+
+
+PrimitiveRasterizer::PrimitiveRasterizer(const RasterizerSettings & settings) {
+    Rasterizer * r = new Rasterizer(settings);
+    core = r;
+    state = r->CreateState();
+}
+
+PrimitiveRasterizer::~PrimitiveRasterizer() {
+    delete state;
+    delete core;
+}
+
+uint32_t PrimitiveRasterizer::GetVertexCount() const {
+    return ((Rasterizer*)core)->vertexCount;
+}
+
+void PrimitiveRasterizer::Begin(Texture * framebuffer, DepthBuffer * depth) {
+    ((Rasterizer*)core)->Begin((RasterizerState*)state, framebuffer, depth);
+}
+
+void PrimitiveRasterizer::Rasterize(const Vector3 * const * vertices, std::vector<Fragment> & out) {
+    Rasterizer * r = (Rasterizer*)core;
+    Primitive prim;
+    prim.io = nullptr;
+    prim.state = (RasterizerState*)state;
+    prim.out = &out;
+    prim.id = no_primitive_id;
+    for(uint32_t i = 0; i < r->vertexCount; ++i) {
+        prim.v[i] = (uint8_t*)vertices[i];
+    }
+    prim.clipXmin = 0;
+    prim.clipYmin = 0;
+    prim.clipXmax = prim.state->framebufferW;
+    prim.clipYmax = prim.state->framebufferH;
+    r->Render(prim);
 }
 
 
@@ -205,10 +369,13 @@ StageProcedure * SoftRaster::CreateRasterizer(Polygon p, DepthBuffering d) {
 
 // Rasterizer impl
 
-Rasterizer::Rasterizer(Polygon p, DepthBuffering d) {
-    switch(p) {
+Rasterizer::Rasterizer(const RasterizerSettings & settings) {
+    switch(settings.shape) {
       case Polygon::Triangles: 
-        PopulateFragments = PopulateFragments_Triangles;
+        PopulateFragments = settings.method == RasterMethod::EdgeFunctions ?
+            PopulateFragments_TriangleEdges
+        :
+            PopulateFragments_Triangles;
         vertexCount = 3; 
         break;
 
@@ -224,16 +391,24 @@ Rasterizer::Rasterizer(Polygon p, DepthBuffering d) {
 
     }
 
-    switch(d) {
-      case DepthBuffering::None:           PassesDepth = new DepthBuffer8Bit;  break;
-      case DepthBuffering::BytePrecision:  PassesDepth = new DepthBuffer8Bit;  break;
-      case DepthBuffering::FloatPrecision: PassesDepth = new DepthBuffer8Bit; break;
-    }
-
-    srcV[0] = nullptr;
-    srcV[1] = nullptr;
-    srcV[2] = nullptr;
-
+    topology = settings.topology;
+    depthMode = settings.depth;
+    method = settings.method;
+    pointSize = std::max<uint16_t>(settings.pointSize, 1);
+    rowKernel = GetRowKernel(settings.vectorized);
+    format = settings.format;
+    spans = settings.spans;
+
+    // spans carry biases only
+    assert(settings.varyingCount <= raster_max_varyings);
+    varyingOffset = settings.varyingOffset;
+    varyingCount = spans ? 0 : settings.varyingCount;
+    perspectiveOffset = settings.perspectiveOffset;
+    varyingKernel = GetVaryingKernel(settings.vectorized);
+    pixelVaryingKernel = GetVaryingKernel(false);
+
+    // bins sharing a depth tile could be run at the same time
+    binSize = (settings.binSize + DepthBuffer::TileSize - 1) / DepthBuffer::TileSize * DepthBuffer::TileSize;
 }
 
 
@@ -250,8 +425,15 @@ StageProcedure::SignatureIO Rasterizer::InputSignature() const {
 StageProcedure::SignatureIO Rasterizer::OutputSignature() const {
     SignatureIO output;
     
-    output.AddSlot(DataType::Fragment);
+    output.AddSlot(spans ? DataType::Span : DataType::Fragment);
+    for(uint32_t i = 0; i < varyingCount; ++i) {
+        output.AddSlot(DataType::Float);
+    }
 
+    if (format == FragmentFormat::PrimitiveID) {
+        output.AddSlot(DataType::PrimitiveID);
+        return output;
+    }
     for(uint32_t i = 0; i < vertexCount; ++i) {
         output.AddSlot(DataType::UserVertex);
     }
@@ -260,74 +442,433 @@ StageProcedure::SignatureIO Rasterizer::OutputSignature() const {
 }
 
 
+StageState * Rasterizer::CreateState() const {
+    return new RasterizerState(
+        depthMode == DepthBuffering::None ? nullptr : new DepthBuffer(depthMode)
+    );
+}
 
 
-// actually performs the 
-void Rasterizer::operator()(RuntimeIO * io_) {
+void Rasterizer::NewRun(RuntimeIO * io) {
+    RasterizerState * state = (RasterizerState*)io->GetState();
+
+    // reallocate vertex stores
+    uint32_t sizeofVertex = io->SizeOf(DataType::UserVertex);
+    if (state->srcVSize != sizeofVertex) {
+        for(uint32_t i = 0; i < 3; ++i) {
+            delete[] state->srcV[i];  
+            state->srcV[i] = new uint8_t[sizeofVertex];   
+        }
+        state->srcVSize = sizeofVertex;
+    }
+    state->primitives.clear();
+    state->primitiveSize = sizeofVertex * vertexCount;
+
+    Begin(state, io->GetFramebuffer(), io->GetDepthBuffer());
+    if (binSize) Bin(io, state);
+}
+
+void Rasterizer::Begin(RasterizerState * state, Texture * framebuffer, DepthBuffer * depth) const {
+    state->assembly = PrimitiveAssembly(topology, vertexCount);
+    state->framebufferW = framebuffer->Width();
+    state->framebufferH = framebuffer->Height();
+    state->binned = false;
+
+    state->target = nullptr;
+    if (depthMode == DepthBuffering::None) return;
+    if (!depth) {
+        depth = state->depth;
+        depth->Clear();
+    }
+    if (depth->Width() != state->framebufferW || depth->Height() != state->framebufferH) {
+        depth->Resize(state->framebufferW, state->framebufferH);
+    }
+    state->target = depth;
+}
+
+
+uint32_t Rasterizer::GetPartitionCount(RuntimeIO * io) const {
+    RasterizerState * state = (RasterizerState*)io->GetState();
+    return state->binned ? state->activeBins.size() : 0;
+}
+
+uint32_t Rasterizer::GetPartitionIterations(RuntimeIO * io, uint32_t partition) const {
+    RasterizerState * state = (RasterizerState*)io->GetState();
+    return state->bins[state->activeBins[partition]].size();
+}
 
-    // initial setup()
-    if (io_->GetCurrentIteration() == 0) {
-        io = io_;
-        count = 0;
 
-        // reallocate vertex stores
+
+// actually performs the 
+void Rasterizer::operator()(RuntimeIO * io) {
+    RasterizerState * state = (RasterizerState*)io->GetState();
+    Primitive prim;
+    prim.io = io;
+    prim.state = state;
+    prim.out = nullptr;
+
+    // Each iteration of a bin is one of the primitives that touch it
+    if (state->binned) {
+        uint32_t bin = state->activeBins[io->GetPartition()];
+        prim.id = state->bins[bin][io->GetCurrentIteration()];
+        const uint32_t * vertices = &state->assembled[prim.id * vertexCount];
         for(uint32_t i = 0; i < vertexCount; ++i) {
-            if (srcV[i]) delete[] srcV[i];  
-            srcV[i] = new uint8_t[io->SizeOf(DataType::UserVertex)];   
+            prim.v[i] = io->GetReadPointer(vertices[i]);
         }
-        framebufferW = io->GetFramebuffer()->Width();
-        framebufferH = io->GetFramebuffer()->Height();
-
-        PassesDepth->Reset(framebufferW, framebufferH);
 
+        prim.clipXmin = (bin % state->binsX) * binSize;
+        prim.clipYmin = (bin / state->binsX) * binSize;
+        prim.clipXmax = std::min(prim.clipXmin + (int)binSize, state->framebufferW);
+        prim.clipYmax = std::min(prim.clipYmin + (int)binSize, state->framebufferH);
+        Render(prim);
+        return;
     }
 
     // Copy the vertex into our stores
-    memcpy(srcV[count++], io->GetReadPointer(), io->SizeOf(DataType::UserVertex));
+    PrimitiveAssembly & assembly = state->assembly;
+    if (io->IsRestart(io->GetCurrentIteration())) assembly.Restart();
+    uint32_t slot = assembly.FreeSlot(slot_handle);
+    memcpy(state->srcV[slot - slot_handle], io->GetReadPointer(), io->SizeOf(DataType::UserVertex));
 
 
     // If our polygon is complete, actually render
-    if (count >= vertexCount){
-        //if (!PassesClipTest()) return;
+    uint32_t handles[3];
+    if (assembly.Add(slot, handles)){
+        for(uint32_t i = 0; i < vertexCount; ++i) {
+            prim.v[i] = state->srcV[handles[i] - slot_handle];
+        }
+        prim.id = no_primitive_id;
+        prim.clipXmin = 0;
+        prim.clipYmin = 0;
+        prim.clipXmax = state->framebufferW;
+        prim.clipYmax = state->framebufferH;
+        Render(prim);
+    }
+}
+
+
+// Vertices are read straight from the inputs rather than copied into the
+// state first. Only those held for primitives of the next batch are copied.
+void Rasterizer::Batch(RuntimeIO * io, uint32_t count) {
+    RasterizerState * state = (RasterizerState*)io->GetState();
+    if (state->binned) {
+        StageProcedure::Batch(io, count);
+        return;
+    }
+
+    uint32_t first = io->GetCurrentIteration();
+    if (vertexCount == 1 && pointSize == 1 && !spans && !varyingCount) {
+        BatchPoints(io, state, first, count);
+        return;
+    }
+
+    Primitive prim;
+    prim.io = io;
+    prim.state = state;
+    prim.out = nullptr;
+    prim.clipXmin = 0;
+    prim.clipYmin = 0;
+    prim.clipXmax = state->framebufferW;
+    prim.clipYmax = state->framebufferH;
+
+    PrimitiveAssembly & assembly = state->assembly;
+    uint32_t handles[3];
+    for(uint32_t n = first; n < first + count; ++n) {
+        if (io->IsRestart(n)) assembly.Restart();
+        if (!assembly.Add(n, handles)) continue;
+
+        for(uint32_t i = 0; i < vertexCount; ++i) {
+            prim.v[i] = handles[i] >= slot_handle ? 
+                state->srcV[handles[i] - slot_handle] 
+            :
+                io->GetReadPointer(handles[i]);
+        }
+        prim.id = no_primitive_id;
+        Render(prim);
+    }
+
+    uint32_t sizeofVertex = io->SizeOf(DataType::UserVertex);
+    for(uint32_t i = 0; i < assembly.held; ++i) {
+        if (assembly.vertices[i] >= slot_handle) continue;
+        uint32_t slot = assembly.FreeSlot(slot_handle);
+        memcpy(state->srcV[slot - slot_handle], io->GetReadPointer(assembly.vertices[i]), sizeofVertex);
+        assembly.vertices[i] = slot;
+    }
+}
+
+
+// Same as PopulateFragments_Points() for single pixels, but without going 
+// through Emit() for each, since points tend to come in great numbers.
+void Rasterizer::BatchPoints(RuntimeIO * io, RasterizerState * state, uint32_t first, uint32_t count) const {
+    const float guardBand = 1 << 20;
+
+    int w = state->framebufferW;
+    int h = state->framebufferH;
+    uint32_t sizeofVertex = io->SizeOf(DataType::UserVertex);
+    uint32_t outputSize = io->GetWriteSize();
+    bool ids = format == FragmentFormat::PrimitiveID;
+    uint32_t table = state->primitives.size();
+    if (ids) state->primitives.resize(table + count*sizeofVertex);
+
+    uint8_t * out = io->GetWriteSpan(count);
+    uint32_t written = 0;
+    Fragment frag;
+    frag.bias0 = 1.f;
+    frag.bias1 = .5f;
+    frag.bias2 = .5f;
+    for(uint32_t n = 0; n < count; ++n) {
+        const uint8_t * v = io->GetReadPointer(first + n);
+        const Vector3 * p = (const Vector3*)v;
+        float cartX = w * (p->x+1)/2.f;
+        float cartY = h * (p->y+1)/2.f;
+        if (!(fabs(cartX) < guardBand && fabs(cartY) < guardBand)) continue;
+
+        int x = (int)floorf(cartX);
+        int y = (int)floorf(cartY);
+        if (x < 0 || x >= w || y < 0 || y >= h) continue;
+        frag.x = x;
+        frag.y = h - y-1;
+        if (state->target && !state->target->Test(frag.x, frag.y, p->z)) continue;
+
+        memcpy(out, &frag, sizeof(Fragment));
+        if (ids) {
+            uint32_t id = table / sizeofVertex;
+            memcpy(&state->primitives[table], v, sizeofVertex);
+            memcpy(out + sizeof(Fragment), &id, sizeof(uint32_t));
+            table += sizeofVertex;
+        } else {
+            memcpy(out + sizeof(Fragment), v, sizeofVertex);
+        }
+        out += outputSize;
+        written++;
+    }
+
+    if (ids) {
+        state->primitives.resize(table);
+        if (table) io->SetPrimitiveTable(&state->primitives[0], state->primitiveSize);
+    }
+    io->CommitSpan(written);
+}
+
+
+void Rasterizer::Render(Primitive & prim) const {
+    for(uint32_t i = 0; i < 3; ++i) {
+        prim.z[i] = i < vertexCount ? ((Vector3*)prim.v[i])->z : 0.f;
+    }
+    if (varyingCount) SetupVaryings(prim);
+    if (!spans) {
+        PopulateFragments(this, prim);
+        return;
+    }
+
+    for(uint32_t i = 0; i < span_rows; ++i) {
+        prim.spans[i].x0 = prim.spans[i].x1 = 0;
+    }
+    PopulateFragments(this, prim);
+    for(uint32_t i = 0; i < span_rows; ++i) {
+        if (prim.spans[i].x0 != prim.spans[i].x1) Write(prim, prim.spans[i]);
+    }
+}
+
+
+void Rasterizer::Emit(Primitive & prim, const Fragment & frag, const float * varyings, uint32_t stride) const {
+    // test the depth 
+    if (prim.state->target && !prim.state->target->Test(frag.x, frag.y, 
+        frag.bias0 * prim.z[0] + 
+        frag.bias1 * prim.z[1] +
+        frag.bias2 * prim.z[2]   )) return;
+
+    if (prim.out) {
+        prim.out->push_back(frag);
+        return;
+    }
+
+    if (!spans) {
+        float values[raster_max_varyings][raster_kernel_max_width];
+        if (varyingCount && !varyings) {
+            const float * bias[3] = {&frag.bias0, &frag.bias1, &frag.bias2};
+            pixelVaryingKernel(prim.varyings, 1, bias, values);
+            varyings = values[0];
+            stride = raster_kernel_max_width;
+        }
+        Write(prim, frag, varyings, stride);
+        return;
+    }
+
+
+    // Rows are walked left to right, so a fragment either continues 
+    // the open span of its row or ends it. Rows of the same block
+    // never share a span slot.
+    Span & span = prim.spans[frag.y % span_rows];
+    if (span.x0 != span.x1) {
+        if (span.y == frag.y && span.x1 == frag.x) {
+            if (span.x1 - span.x0 == 1) {
+                span.delta0 = frag.bias0 - span.bias0;
+                span.delta1 = frag.bias1 - span.bias1;
+                span.delta2 = frag.bias2 - span.bias2;
+            }
+            span.x1++;
+            return;
+        }
+        Write(prim, span);
+    }
+    span.x0 = frag.x;
+    span.x1 = frag.x+1;
+    span.y  = frag.y;
+    span.bias0 = frag.bias0;
+    span.bias1 = frag.bias1;
+    span.bias2 = frag.bias2;
+    span.delta0 = span.delta1 = span.delta2 = 0.f;
+}
+
+
+template<typename T>
+void Rasterizer::Write(Primitive & prim, const T & unit, const float * varyings, uint32_t stride) const {
+    RuntimeIO * io = prim.io;
+    io->WriteNext<T>(&unit);
+    if (varyings) {
+        for(uint32_t i = 0; i < varyingCount; ++i) {
+            io->WriteNext<float>(varyings + i*stride);
+        }
+    }
+
+    if (format == FragmentFormat::PrimitiveID) {
+        if (prim.id == no_primitive_id) AddPrimitive(io, prim);
+        io->WriteNext<uint32_t>(&prim.id);
+        io->Commit();
+        return;
+    }
     
-        // clear out old results
-        fragments.clear();
+    const int offset = sizeof(T) + (varyings ? varyingCount*sizeof(float) : 0);
+    int sizeofVertex = io->SizeOf(DataType::UserVertex);
+    for(uint32_t i = 0; i < vertexCount; ++i) {
+        memcpy(io->GetWritePointer() +offset+sizeofVertex*i, prim.v[i], sizeofVertex);
+    }
 
+    io->Commit();
+}
 
-        // Populates fragments
-        PopulateFragments(this);
 
+// Attributes are interpolated as planes over the biases. For perspective, 
+// they are divided by w first and the result divided by the interpolated 1/w.
+void Rasterizer::SetupVaryings(Primitive & prim) const {
+    VaryingPlanes & planes = prim.varyings;
+    planes.count = varyingCount;
+    planes.perspective = perspectiveOffset >= 0;
+    for(uint32_t i = 0; i < 3; ++i) {
+        if (i >= vertexCount) {
+            planes.invW[i] = 0.f;
+            for(uint32_t n = 0; n < varyingCount; ++n) {
+                planes.values[n][i] = 0.f;
+            }
+            continue;
+        }
 
-        // commit frags
-        Fragment * out;
-        const int offset = sizeof(Fragment);
-        int sizeofVertex = io->SizeOf(DataType::UserVertex);
-        float v0z = ((Vector3*)(srcV[0]))->z;
-        float v1z = ((Vector3*)(srcV[1]))->z;
-        float v2z = ((Vector3*)(srcV[2]))->z;
-        for(int i = 0; i < fragments.size(); ++i) { 
-            out = &fragments[i];
+        const float * values = (const float*)(prim.v[i] + varyingOffset);
+        float invW = 1.f;
+        if (planes.perspective) invW = 1.f / *(const float*)(prim.v[i] + perspectiveOffset);
+        planes.invW[i] = invW;
+        for(uint32_t n = 0; n < varyingCount; ++n) {
+            planes.values[n][i] = values[n] * invW;
+        }
+    }
+}
 
-            // test the depth 
-            if (!PassesDepth->Test(out->x, out->y, 
-                out->bias0 * v0z + 
-                out->bias1 * v1z +
-                out->bias2 * v2z   )) continue;
 
-            io->WriteNext<Fragment>(out);
-            
-            
+void Rasterizer::AddPrimitive(RuntimeIO * io, Primitive & prim) const {
+    RasterizerState * state = prim.state;
+    uint32_t sizeofVertex = state->primitiveSize / vertexCount;
+    prim.id = state->primitives.size() / state->primitiveSize;
+    state->primitives.resize(state->primitives.size() + state->primitiveSize);
+    for(uint32_t i = 0; i < vertexCount; ++i) {
+        memcpy(&state->primitives[prim.id*state->primitiveSize + i*sizeofVertex], prim.v[i], sizeofVertex);
+    }
+    io->SetPrimitiveTable(&state->primitives[0], state->primitiveSize);
+}
 
-            memcpy(io->GetWritePointer() +offset,                srcV[0], sizeofVertex);
-            memcpy(io->GetWritePointer() +offset+sizeofVertex,   srcV[1], sizeofVertex);
-            memcpy(io->GetWritePointer() +offset+sizeofVertex*2, srcV[2], sizeofVertex);
 
-            
+bool Rasterizer::Occluded(const Primitive & prim, int x0, int y0, int x1, int y1, float minZ, float maxZ) const {
+    return prim.state->target && prim.state->target->Rejects(x0, y0, x1, y1, minZ, maxZ);
+}
+
+
+bool Rasterizer::Bounds(const Primitive & prim, int & xmin, int & ymin, int & xmax, int & ymax) const {
+    const Vector3 * v = (Vector3*)prim.v[0];
+    float minX = v->x, maxX = v->x;
+    float minY = v->y, maxY = v->y;
+    for(uint32_t i = 1; i < vertexCount; ++i) {
+        v = (Vector3*)prim.v[i];
+        minX = std::min(minX, v->x); maxX = std::max(maxX, v->x);
+        minY = std::min(minY, v->y); maxY = std::max(maxY, v->y);
+    }
 
-            io->Commit();
+    int w = prim.state->framebufferW;
+    int h = prim.state->framebufferH;
+
+    // pixel centers up to the last partial pixel may be covered,
+    // and points cover pixels around their centers.
+    int extend = method == RasterMethod::EdgeFunctions || vertexCount < 3 ? 1 : 0;
+    float pad = vertexCount == 1 ? pointSize : 0;
+    xmin = (int)std::max(w * (minX+1)/2.f - pad, (float)prim.clipXmin);
+    ymin = (int)std::max(h * (minY+1)/2.f - pad, (float)prim.clipYmin);
+    xmax = std::min((int)std::min(w * (maxX+1)/2.f + pad, (float)prim.clipXmax) + extend, prim.clipXmax);
+    ymax = std::min((int)std::min(h * (maxY+1)/2.f + pad, (float)prim.clipYmax) + extend, prim.clipYmax);
+    return xmin < xmax && ymin < ymax;
+}
+
+
+void Rasterizer::Bin(RuntimeIO * io, RasterizerState * state) const {
+    state->binsX = (state->framebufferW + binSize - 1) / binSize;
+    state->binsY = (state->framebufferH + binSize - 1) / binSize;
+    state->bins.resize(state->binsX * state->binsY);
+    for(uint32_t i = 0; i < state->bins.size(); ++i) {
+        state->bins[i].clear();
+    }
+    state->activeBins.clear();
+
+    Primitive prim;
+    prim.io = io;
+    prim.state = state;
+    prim.out = nullptr;
+    prim.clipXmin = 0;
+    prim.clipYmin = 0;
+    prim.clipXmax = state->framebufferW;
+    prim.clipYmax = state->framebufferH;
+
+    PrimitiveAssembly assembly(topology, vertexCount);
+    state->assembled.clear();
+
+    int xmin, ymin, xmax, ymax;
+    uint32_t handles[3];
+    for(uint32_t iteration = 0; iteration < io->GetIterationCount(); ++iteration) {
+        if (io->IsRestart(iteration)) assembly.Restart();
+        if (!assembly.Add(iteration, handles)) continue;
+
+        uint32_t n = state->assembled.size() / vertexCount;
+        for(uint32_t i = 0; i < vertexCount; ++i) {
+            state->assembled.push_back(handles[i]);
+            prim.v[i] = io->GetReadPointer(handles[i]);
+        }
+
+        // bins are rasterized concurrently, so the table is filled 
+        // up front with each primitive's ID being its position in the draw
+        if (format == FragmentFormat::PrimitiveID) AddPrimitive(io, prim);
+        if (!Bounds(prim, xmin, ymin, xmax, ymax)) continue;
+
+        for(int by = ymin / binSize; by <= (ymax-1) / binSize; ++by) {
+            for(int bx = xmin / binSize; bx <= (xmax-1) / binSize; ++bx) {
+                state->bins[bx + by*state->binsX].push_back(n);
+            }
         }
-        count = 0;
     }
+
+    for(uint32_t i = 0; i < state->bins.size(); ++i) {
+        if (!state->bins[i].empty()) state->activeBins.push_back(i);
+    }
+    state->binned = state->activeBins.size() > 1;
+
+    // primitives are assembled as they come instead
+    if (!state->binned) state->primitives.clear();
 }
 
 
@@ -346,44 +887,41 @@ void Rasterizer::operator()(RuntimeIO * io_) {
 // Rasterization of the triangle 
 // by testing if fragments lie within the triangle
 // using barycentric coordinates
-void Rasterizer::PopulateFragments_Triangles(Rasterizer * r) {
+void Rasterizer::PopulateFragments_Triangles(const Rasterizer * r, Primitive & prim) {
 
-    static Vector3 v0, v1, v2;
-    static Fragment frag;
+    Vector3 v0, v1, v2;
+    Fragment frag;
     int boundXmin, boundXmax,
         boundYmin, boundYmax;
 
 
 
 
-    v0 = *((Vector3*)r->srcV[0]);
-    v1 = *((Vector3*)r->srcV[1]);
-    v2 = *((Vector3*)r->srcV[2]);
+    v0 = *((Vector3*)prim.v[0]);
+    v1 = *((Vector3*)prim.v[1]);
+    v2 = *((Vector3*)prim.v[2]);
+
+
+    // first lets decide what texels should even be considered
+    // A superset of the texels to test would be the bounding box of the triangle
+    if (!r->Bounds(prim, boundXmin, boundYmin, boundXmax, boundYmax)) return;
+    if (r->Occluded(prim, boundXmin, boundYmin, boundXmax, boundYmax, 
+                    std::min(v0.z, std::min(v1.z, v2.z)),
+                    std::max(v0.z, std::max(v1.z, v2.z)))) return;
 
 
     // prepares the barycentric transfrom
     // used to test whether or not points are within the triangle
     // and to produce the varying biases. SO USEFUL
     BarycentricTransform baryTest(&v0, &v1, &v2,
-                                  r->io->GetFramebuffer()->Width(), r->io->GetFramebuffer()->Height()              
+                                  prim.state->framebufferW, prim.state->framebufferH              
                                   );
 
-
-    // first lets decide what texels should even be considered
-    // A superset of the texels to test would be the bounding box of the triangle
-    boundXmin = r->framebufferW * ((std::min(std::min(v0.x, v1.x), v2.x))+1)/2.f;
-    boundYmin = r->framebufferH * ((std::min(std::min(v0.y, v1.y), v2.y))+1)/2.f;
-    boundXmax = r->framebufferW * ((std::max(std::max(v0.x, v1.x), v2.x))+1)/2.f;
-    boundYmax = r->framebufferH * ((std::max(std::max(v0.y, v1.y), v2.y))+1)/2.f;
-    
-
     
             
     
     for(int y = boundYmin; y < boundYmax; ++y) {
-        if (y < 0 || y >= r->framebufferH) continue;   
         for(int x = boundXmin; x < boundXmax; ++x) {
-            if (x < 0 || x >= r->framebufferW) continue;                
 
             // transforms cartesion coords into barycentric coordinates
             baryTest.Transform(x, y, 
@@ -397,9 +935,9 @@ void Rasterizer::PopulateFragments_Triangles(Rasterizer * r) {
 
 
             frag.x = x;
-            frag.y = r->io->GetFramebuffer()->Height() - y-1;
+            frag.y = prim.state->framebufferH - y-1;
 
-            r->fragments.push_back(frag);
+            r->Emit(prim, frag);
         
         }
     }
@@ -408,20 +946,329 @@ void Rasterizer::PopulateFragments_Triangles(Rasterizer * r) {
 }
 
 
-void Rasterizer::PopulateFragments_Lines(Rasterizer *) {
-    // TODO
-}
+// Rasterization of the triangle by stepping its edge functions.
+// Positions are in fixed-point with subpixel bits, so the edge functions 
+// are exact and only need to be added to when moving between pixels.
+void Rasterizer::PopulateFragments_TriangleEdges(const Rasterizer * r, Primitive & prim) {
+    const int   subpixelBits  = 4;
+    const int   subpixelScale = 1 << subpixelBits;
+    const float guardBand     = 1 << 20; // beyond this (in pixels), edge values would overflow
+    const int   blockSize     = 8;
+
+
+    int w = prim.state->framebufferW;
+    int h = prim.state->framebufferH;
+    int64_t vx[3], vy[3];
+    for(uint32_t i = 0; i < 3; ++i) {
+        const Vector3 * v = (Vector3*)prim.v[i];
+        float cartX = w * (v->x+1)/2.f;
+        float cartY = h * (v->y+1)/2.f;
+        if (!(fabs(cartX) < guardBand && fabs(cartY) < guardBand)) {
+            PopulateFragments_Triangles(r, prim);
+            return;
+        }
+        vx[i] = (int64_t)lrintf(cartX * subpixelScale);
+        vy[i] = (int64_t)lrintf(cartY * subpixelScale);
+    }
+
+    // Work with counter-clockwise triangles so that inside is positive for every edge
+    int64_t area = (vx[1]-vx[0])*(vy[2]-vy[0]) - (vy[1]-vy[0])*(vx[2]-vx[0]);
+    bool swapped = area < 0;
+    if (!area) return;
+    if (swapped) {
+        std::swap(vx[1], vx[2]);
+        std::swap(vy[1], vy[2]);
+        area = -area;
+    }
 
 
-void Rasterizer::PopulateFragments_Points(Rasterizer *) {
-    // TODO
+    // Only pixels whose centers lie within the subpixel bounds can be covered
+    int boundXmin, boundXmax,
+        boundYmin, boundYmax;
+    if (!r->Bounds(prim, boundXmin, boundYmin, boundXmax, boundYmax)) return;
+    int64_t minX = std::min(vx[0], std::min(vx[1], vx[2]));
+    int64_t minY = std::min(vy[0], std::min(vy[1], vy[2]));
+    int64_t maxX = std::max(vx[0], std::max(vx[1], vx[2]));
+    int64_t maxY = std::max(vy[0], std::max(vy[1], vy[2]));
+    boundXmin = std::max<int64_t>(boundXmin, (minX - subpixelScale/2 + subpixelScale - 1) >> subpixelBits);
+    boundYmin = std::max<int64_t>(boundYmin, (minY - subpixelScale/2 + subpixelScale - 1) >> subpixelBits);
+    boundXmax = std::min<int64_t>(boundXmax, ((maxX - subpixelScale/2) >> subpixelBits) + 1);
+    boundYmax = std::min<int64_t>(boundYmax, ((maxY - subpixelScale/2) >> subpixelBits) + 1);
+    if (boundXmin >= boundXmax || boundYmin >= boundYmax) return;
+
+
+    // Edge i is opposite vertex i, so its value is the weight of that vertex.
+    // A pixel center exactly on an edge is only covered if the edge is 
+    // a top or left edge; the others are made to fail by one.
+    TriangleEdges edges;
+    int64_t px = ((int64_t)boundXmin << subpixelBits) + subpixelScale/2;
+    int64_t py = ((int64_t)boundYmin << subpixelBits) + subpixelScale/2;
+    for(uint32_t i = 0; i < 3; ++i) {
+        uint32_t a = (i+1)%3;
+        uint32_t b = (i+2)%3;
+        int64_t dx = vx[b] - vx[a];
+        int64_t dy = vy[b] - vy[a];
+
+        edges.stepX[i]  = -dy * subpixelScale;
+        edges.stepY[i]  =  dx * subpixelScale;
+        edges.fill[i]   = (dy < 0 || (dy == 0 && dx < 0)) ? 0 : -1;
+        edges.origin[i] = dx * (py - vy[a]) - dy * (px - vx[a]) + edges.fill[i];
+    }
+    edges.originX = boundXmin;
+    edges.originY = boundYmin;
+    edges.invArea = 1.f / area;
+    edges.swapped = swapped;
+
+    float z[3] = {
+        ((Vector3*)prim.v[0])->z,
+        ((Vector3*)prim.v[swapped ? 2 : 1])->z,
+        ((Vector3*)prim.v[swapped ? 1 : 2])->z
+    };
+    float minZ = std::min(z[0], std::min(z[1], z[2]));
+    float maxZ = std::max(z[0], std::max(z[1], z[2]));
+    if (boundXmax - boundXmin <= blockSize && boundYmax - boundYmin <= blockSize) {
+        if (r->Occluded(prim, boundXmin, boundYmin, boundXmax, boundYmax, minZ, maxZ)) return;
+        RasterizeBlock(r, prim, edges, boundXmin, boundYmin, boundXmax, boundYmax, true);
+        return;
+    }
+
+    // depth across the plane of the triangle, 
+    // for bounding the depth within each block
+    float dzdx = 0.f, dzdy = 0.f;
+    for(uint32_t i = 0; i < 3; ++i) {
+        dzdx += edges.stepX[i] * edges.invArea * z[i];
+        dzdy += edges.stepY[i] * edges.invArea * z[i];
+    }
+
+
+    // Larger triangles are walked in screen aligned blocks. Since edge functions 
+    // are linear, the extremes of each over a block are at its corners: blocks 
+    // outside of any edge are skipped, and blocks inside all edges need no tests.
+    for(int by = boundYmin - boundYmin % blockSize; by < boundYmax; by += blockSize) {
+        int y0 = std::max(by, boundYmin);
+        int y1 = std::min(by + blockSize, boundYmax);
+        for(int bx = boundXmin - boundXmin % blockSize; bx < boundXmax; bx += blockSize) {
+            int x0 = std::max(bx, boundXmin);
+            int x1 = std::min(bx + blockSize, boundXmax);
+
+            bool outside = false;
+            bool inside  = true;
+            float blockZ = 0.f;
+            float magnitude = 0.f;
+            for(uint32_t i = 0; i < 3; ++i) {
+                int64_t e     = edges.origin[i] + (x0 - boundXmin)*edges.stepX[i] + (y0 - boundYmin)*edges.stepY[i];
+                int64_t acrossX = (x1 - x0 - 1)*edges.stepX[i];
+                int64_t acrossY = (y1 - y0 - 1)*edges.stepY[i];
+                int64_t hi = e + std::max<int64_t>(acrossX, 0) + std::max<int64_t>(acrossY, 0);
+                int64_t lo = e + std::min<int64_t>(acrossX, 0) + std::min<int64_t>(acrossY, 0);
+                if (hi < 0) outside = true;
+                if (lo < 0) inside  = false;
+                float term = (e - edges.fill[i]) * edges.invArea * z[i];
+                blockZ += term;
+                magnitude += fabs(term);
+            }
+            if (outside) continue;
+
+            // whole blocks behind what was already drawn are skipped. 
+            // The plane is evaluated far outside of thin triangles, so
+            // rounding is allowed for in proportion to the terms.
+            float acrossX = dzdx * (x1 - x0 - 1);
+            float acrossY = dzdy * (y1 - y0 - 1);
+            magnitude = (magnitude + fabs(acrossX) + fabs(acrossY)) * 1e-5f;
+            float blockMin = blockZ + std::min(acrossX, 0.f) + std::min(acrossY, 0.f) - magnitude;
+            float blockMax = blockZ + std::max(acrossX, 0.f) + std::max(acrossY, 0.f) + magnitude;
+            if (r->Occluded(prim, x0, y0, x1, y1, std::max(blockMin, minZ), std::min(blockMax, maxZ))) continue;
+
+            RasterizeBlock(r, prim, edges, x0, y0, x1, y1, !inside);
+        }
+    }
+}
+
+// Emits the fragments of the triangle within [x0, x1) and [y0, y1), 
+// which is at most a block wide. Without testing, every pixel is assumed to be covered.
+void Rasterizer::RasterizeBlock(const Rasterizer * r, Primitive & prim, const TriangleEdges & edges, int x0, int y0, int x1, int y1, bool test) {
+    Fragment frag;
+    float * bias[3] = {&frag.bias0, &frag.bias1, &frag.bias2};
+    if (edges.swapped) std::swap(bias[1], bias[2]);
+
+    int h = prim.state->framebufferH;
+    uint32_t width = x1 - x0;
+    float rowBias[3][raster_kernel_max_width];
+    float rowVaryings[raster_max_varyings][raster_kernel_max_width];
+    const float * vertexBias[3] = {
+        rowBias[0],
+        rowBias[edges.swapped ? 2 : 1],
+        rowBias[edges.swapped ? 1 : 2]
+    };
+    EdgeRow row;
+    for(uint32_t i = 0; i < 3; ++i) {
+        row.e[i]     = edges.origin[i] + (x0 - edges.originX)*edges.stepX[i] + (y0 - edges.originY)*edges.stepY[i];
+        row.stepX[i] = edges.stepX[i];
+        row.fill[i]  = edges.fill[i];
+    }
+    row.invArea = edges.invArea;
+
+    for(int y = y0; y < y1; ++y) {
+        uint32_t covered = r->rowKernel(row, width, rowBias);
+        if (!test) covered = (1 << width) - 1;
+        if (r->varyingCount && covered) r->varyingKernel(prim.varyings, width, vertexBias, rowVaryings);
+
+        for(uint32_t i = 0; covered; ++i, covered >>= 1) {
+            if (!(covered & 1)) continue;
+            *bias[0] = rowBias[0][i];
+            *bias[1] = rowBias[1][i];
+            *bias[2] = rowBias[2][i];
+            frag.x = x0 + i;
+            frag.y = h - y-1;
+
+            r->Emit(prim, frag, r->varyingCount ? &rowVaryings[0][i] : nullptr, raster_kernel_max_width);
+        }
+        row.e[0] += edges.stepY[0];
+        row.e[1] += edges.stepY[1];
+        row.e[2] += edges.stepY[2];
+    }
 }
 
 
+// Lines are stepped with an integer DDA from the center of the pixel holding
+// the first vertex towards the pixel holding the second, one pixel along the longer 
+// axis at a time. The last pixel is left out, so that connected lines 
+// never cover the same pixel twice. bias0 and bias1 follow the line.
+void Rasterizer::PopulateFragments_Lines(const Rasterizer * r, Primitive & prim) {
+    const float guardBand = 1 << 20; // keeps fixed-point steps from overflowing
+    const int   fracBits  = 16;
+
+    int w = prim.state->framebufferW;
+    int h = prim.state->framebufferH;
+    const Vector3 * a = (Vector3*)prim.v[0];
+    const Vector3 * b = (Vector3*)prim.v[1];
+    float ax = w * (a->x+1)/2.f;
+    float ay = h * (a->y+1)/2.f;
+    float bx = w * (b->x+1)/2.f;
+    float by = h * (b->y+1)/2.f;
+
+    float t0 = 0.f, t1 = 1.f;
+    if (!ClipSegment(ax, ay, bx, by, -guardBand, -guardBand, guardBand, guardBand, t0, t1)) return;
+    int64_t x0 = (int64_t)floorf(ax + (bx-ax)*t0);
+    int64_t y0 = (int64_t)floorf(ay + (by-ay)*t0);
+    int64_t x1 = (int64_t)floorf(ax + (bx-ax)*t1);
+    int64_t y1 = (int64_t)floorf(ay + (by-ay)*t1);
+    int64_t n  = std::max(std::abs(x1-x0), std::abs(y1-y0));
+    if (!n) return;
+
+
+    const int64_t one = (int64_t)1 << fracBits;
+    int64_t fx = x0 * one + one/2;
+    int64_t fy = y0 * one + one/2;
+    int64_t stepX = (x1-x0) * one / n;
+    int64_t stepY = (y1-y0) * one / n;
+    float tStep = (t1 - t0) / n;
+
+
+    // Only the steps that land within the clipping region are walked
+    int64_t first = 0, last = n;
+    int64_t start[2] = {fx, fy};
+    int64_t step[2] = {stepX, stepY};
+    int64_t lo[2] = {prim.clipXmin * one, prim.clipYmin * one};
+    int64_t hi[2] = {prim.clipXmax * one, prim.clipYmax * one};
+    for(uint32_t i = 0; i < 2; ++i) {
+        if (!step[i]) {
+            if (start[i] < lo[i] || start[i] >= hi[i]) return;
+            continue;
+        }
+        double enter = (lo[i] - start[i]) / (double)step[i];
+        double exit  = (hi[i] - start[i]) / (double)step[i];
+        if (enter > exit) std::swap(enter, exit);
+        first = std::max(first, (int64_t)floor(enter) - 1);
+        last  = std::min(last,  (int64_t)ceil(exit) + 1);
+    }
+    if (first >= last) return;
+
+    Fragment frag;
+    frag.bias2 = 0.f;
+    fx += first * stepX;
+    fy += first * stepY;
+    for(int64_t i = first; i < last; ++i, fx += stepX, fy += stepY) {
+        int x = fx >> fracBits;
+        int y = fy >> fracBits;
+        if (x < prim.clipXmin || x >= prim.clipXmax ||
+            y < prim.clipYmin || y >= prim.clipYmax) continue;
+
+        frag.bias1 = t0 + i * tStep;
+        frag.bias0 = 1.f - frag.bias1;
+        frag.x = x;
+        frag.y = h - y-1;
+        r->Emit(prim, frag);
+    }
+}
 
 
+// Points cover a square of pointSize pixels around the pixel holding the vertex.
+// bias0 is always 1, while bias1 and bias2 are the position within the 
+// square from the left and from the top, as from a point sprite.
+void Rasterizer::PopulateFragments_Points(const Rasterizer * r, Primitive & prim) {
+    const float guardBand = 1 << 20;
+
+    int w = prim.state->framebufferW;
+    int h = prim.state->framebufferH;
+    const Vector3 * v = (Vector3*)prim.v[0];
+    float cartX = w * (v->x+1)/2.f;
+    float cartY = h * (v->y+1)/2.f;
+    if (!(fabs(cartX) < guardBand && fabs(cartY) < guardBand)) return;
+
+    Fragment frag;
+    frag.bias0 = 1.f;
+    int size = r->pointSize;
+    int left   = (int)floorf(cartX) - (size-1)/2;
+    int bottom = (int)floorf(cartY) - (size-1)/2;
+    if (size == 1) {
+        if (left   < prim.clipXmin || left   >= prim.clipXmax ||
+            bottom < prim.clipYmin || bottom >= prim.clipYmax) return;
+        frag.bias1 = .5f;
+        frag.bias2 = .5f;
+        frag.x = left;
+        frag.y = h - bottom-1;
+        r->Emit(prim, frag);
+        return;
+    }
+
+    int x0 = std::max(left, prim.clipXmin);
+    int y0 = std::max(bottom, prim.clipYmin);
+    int x1 = std::min(left + size, prim.clipXmax);
+    int y1 = std::min(bottom + size, prim.clipYmax);
+    if (x0 >= x1 || y0 >= y1) return;
+    if (r->Occluded(prim, x0, y0, x1, y1, v->z, v->z)) return;
+
+    float invSize = 1.f / size;
+    for(int y = y0; y < y1; ++y) {
+        frag.bias2 = (bottom + size - y - .5f) * invSize;
+        frag.y = h - y-1;
+        for(int x = x0; x < x1; ++x) {
+            frag.bias1 = (x - left + .5f) * invSize;
+            frag.x = x;
+            r->Emit(prim, frag);
+        }
+    }
+}
 
 
 
 
+///// Statics//////
 
+// Liang-Barsky: narrows [t0, t1] to the part of the segment from a to b within the rectangle.
+// Returns false if none of it is.
+bool ClipSegment(float ax, float ay, float bx, float by, float xmin, float ymin, float xmax, float ymax, float & t0, float & t1) {
+    float p[4] = {ax - bx, bx - ax, ay - by, by - ay};
+    float q[4] = {ax - xmin, xmax - ax, ay - ymin, ymax - ay};
+    for(uint32_t i = 0; i < 4; ++i) {
+        if (p[i] == 0.f) {
+            if (!(q[i] >= 0.f)) return false;
+            continue;
+        }
+        float t = q[i] / p[i];
+        if (p[i] < 0.f) t0 = std::max(t0, t);
+        else            t1 = std::min(t1, t);
+    }
+    return t0 <= t1;
+}
@@ -0,0 +1,172 @@
+#include <SoftRaster/DepthBuffer.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+using namespace SoftRaster;
+
+
+// Depths are compared as keys, where a greater key is nearer and 0 is the farthest.
+// 8 and 16-bit depths are the key itself. Float depths are kept
+// from 0.f to 1.f, where the bits of the float already order like the key.
+
+DepthBuffer::DepthBuffer(DepthBuffering p, bool rev) {
+    precision = p;
+    reversed = rev;
+    switch(precision) {
+      case DepthBuffering::ShortPrecision: unitSize = sizeof(uint16_t); break;
+      case DepthBuffering::FloatPrecision: unitSize = sizeof(float);    break;
+      default:                             unitSize = sizeof(uint8_t);  break;
+    }
+
+    data = nullptr;
+    tileGeneration = nullptr;
+    tileFarthest = nullptr;
+    tileDirty = nullptr;
+    generation = 1;
+    w = 0;
+    h = 0;
+    tilesX = 0;
+    numTiles = 0;
+}
+
+DepthBuffer::~DepthBuffer() {
+    free(data);
+    free(tileGeneration);
+    free(tileFarthest);
+    free(tileDirty);
+}
+
+void DepthBuffer::Clear() {
+    // tiles of an older generation read as cleared
+    if (!++generation) {
+        memset(tileGeneration, 0, numTiles*sizeof(uint32_t));
+        generation = 1;
+    }
+}
+
+void DepthBuffer::Resize(uint16_t fbW, uint16_t fbH) {
+    w = fbW;
+    h = fbH;
+    data = (uint8_t*)realloc(data, w*h*unitSize);
+
+    tilesX = (w + TileSize - 1) / TileSize;
+    numTiles = tilesX * ((h + TileSize - 1) / TileSize);
+    tileGeneration = (uint32_t*)realloc(tileGeneration, numTiles*sizeof(uint32_t));
+    tileFarthest   = (uint32_t*)realloc(tileFarthest,   numTiles*sizeof(uint32_t));
+    tileDirty      = (uint8_t*) realloc(tileDirty,      numTiles);
+    memset(tileGeneration, 0, numTiles*sizeof(uint32_t));
+    generation = 1;
+}
+
+bool DepthBuffer::Test(uint16_t x, uint16_t y, float homogenousZ) {
+    if (homogenousZ < -1.f || homogenousZ > 1.f) return false;
+    uint32_t key = KeyOf(homogenousZ);
+    switch(unitSize) {
+      case sizeof(uint8_t):  return TestAs<uint8_t> (x, y, key);
+      case sizeof(uint16_t): return TestAs<uint16_t>(x, y, key);
+      default:               return TestAs<uint32_t>(x, y, key);
+    }
+}
+
+float DepthBuffer::GetDepth(uint16_t x, uint16_t y) const {
+    uint32_t tile = x / TileSize + ((h-1-y) / TileSize)*tilesX;
+    float nearness = 0.f;
+    if (tileGeneration[tile] == generation) {
+        switch(unitSize) {
+          case sizeof(uint8_t):  nearness = data[x + y*w] / (float)UINT8_MAX; break;
+          case sizeof(uint16_t): nearness = ((uint16_t*)data)[x + y*w] / (float)UINT16_MAX; break;
+          default:               memcpy(&nearness, (float*)data + x + y*w, sizeof(float)); break;
+        }
+    }
+    return reversed ? 1.f - nearness*2.f : nearness*2.f - 1.f;
+}
+
+bool DepthBuffer::Rejects(int x0, int y0, int x1, int y1, float minZ, float maxZ) {
+    float nearest = reversed ? (1.f - minZ)/2.f : (maxZ + 1.f)/2.f;
+    if (nearest < 0.f) return true;
+    if (nearest > 1.f) return false;
+
+    // interpolated depths may round just past the given bounds
+    uint32_t key = Quantize(std::min(nearest + 1e-6f, 1.f));
+
+    for(int ty = y0 / TileSize; ty <= (y1-1) / TileSize; ++ty) {
+        for(int tx = x0 / TileSize; tx <= (x1-1) / TileSize; ++tx) {
+            uint32_t tile = tx + ty*tilesX;
+            uint32_t farthest;
+            switch(unitSize) {
+              case sizeof(uint8_t):  farthest = Farthest<uint8_t> (tile, tx, ty); break;
+              case sizeof(uint16_t): farthest = Farthest<uint16_t>(tile, tx, ty); break;
+              default:               farthest = Farthest<uint32_t>(tile, tx, ty); break;
+            }
+            if (key > farthest) return false;
+        }
+    }
+    return true;
+}
+
+
+template<typename T>
+bool DepthBuffer::TestAs(uint16_t x, uint16_t y, uint32_t key) {
+    int tx = x / TileSize;
+    int ty = (h-1-y) / TileSize;
+    uint32_t tile = tx + ty*tilesX;
+    if (tileGeneration[tile] != generation) ClaimTile(tile, tx, ty);
+
+    T & stored = ((T*)data)[x + y*w];
+    if (key > stored) {
+        stored = key;
+        tileDirty[tile] = 1;
+        return true;
+    }
+    return false;
+}
+
+// Writes only mark the tile; its farthest depth is found again when next needed.
+template<typename T>
+uint32_t DepthBuffer::Farthest(uint32_t tile, int tx, int ty) {
+    if (tileGeneration[tile] != generation) return 0;
+    if (!tileDirty[tile]) return tileFarthest[tile];
+
+    int xEnd = std::min((tx+1) * TileSize, (int)w);
+    int yEnd = std::min((ty+1) * TileSize, (int)h);
+    T farthest = ((T*)data)[tx * TileSize + (h-1 - ty*TileSize)*w];
+    for(int y = ty * TileSize; y < yEnd; ++y) {
+        const T * row = ((T*)data) + (h-1-y)*w;
+        for(int x = tx * TileSize; x < xEnd; ++x) {
+            farthest = std::min(farthest, row[x]);
+        }
+    }
+    tileFarthest[tile] = farthest;
+    tileDirty[tile] = 0;
+    return farthest;
+}
+
+uint32_t DepthBuffer::KeyOf(float homogenousZ) const {
+    return Quantize(reversed ? (1.f - homogenousZ)/2.f : (homogenousZ + 1.f)/2.f);
+}
+
+// Converts a nearness from 0.f (farthest) to 1.f into a key
+uint32_t DepthBuffer::Quantize(float d) const {
+    switch(unitSize) {
+      case sizeof(uint8_t):  return (uint8_t)(d * UINT8_MAX);
+      case sizeof(uint16_t): return (uint16_t)(d * UINT16_MAX);
+      default: {
+        uint32_t bits;
+        memcpy(&bits, &d, sizeof(float));
+        return bits;
+      }
+    }
+}
+
+// Clears a tile from an older generation, since it is about to be written to
+void DepthBuffer::ClaimTile(uint32_t tile, int tx, int ty) {
+    int xEnd = std::min((tx+1) * TileSize, (int)w);
+    int yEnd = std::min((ty+1) * TileSize, (int)h);
+    for(int y = ty * TileSize; y < yEnd; ++y) {
+        memset(data + (tx * TileSize + (h-1-y)*w)*unitSize, 0, (xEnd - tx * TileSize)*unitSize);
+    }
+    tileGeneration[tile] = generation;
+    tileFarthest[tile] = 0;
+    tileDirty[tile] = 0;
+}
@@ -1,6 +1,8 @@
 #include <SoftRaster/Pipeline.h>
 #include <SoftRaster/StageProcedure.h>
 #include <SoftRaster/Primitives.h>
+#include "WorkerPool.h"
+#include <algorithm>
 #include <cassert>
 
 #ifdef SR_PROGRAM_DIAGNOSTICS
@@ -17,8 +19,12 @@ const char * p_error_c__io_mismatch              = "ERROR: The current end of th
 
 const uint32_t pipeline_program_init_cache_size     = 512; // 512 KB should be fine to start
 const float    pipeline_program_cache_resize_factor = 1.2f; // rather than increase load factor, just go to how many ytes we need times an offset factor
+const uint32_t pipeline_program_min_chunk_iters     = 256;  // below this, splitting a stage across workers costs more than it saves
+const uint32_t pipeline_program_chunks_per_worker   = 4;    // extra chunks so uneven iterations still balance out
 
-static uint32_t SignatureSize(const StageProcedure::SignatureIO &, uint32_t sizeofVertex);
+static uint32_t FixedSizeOf(DataType);
+
+const uint32_t Pipeline::Program::RestartIndex;
 
 std::string Pipeline::PushExecutionStage(StageProcedure * proc) {
     const StageProcedure::SignatureIO pipelineHead (
@@ -51,8 +57,11 @@ Pipeline::Program * Pipeline::Compile() {
         return nullptr;
     }
     Program * out = new Program("");
-    for(int i = 0; i < procs.size(); ++i) {
+    for(uint32_t i = 0; i < procs.size(); ++i) {
         out->cachedProcs.push_back(procs[i]);
+        out->states.push_back(procs[i]->CreateState());
+        out->layouts.push_back(StageLayout());
+        out->layouts[i].Build(procs[i]);
     }
 
     return out;
@@ -70,6 +79,30 @@ void Pipeline::Clear() {
 Pipeline::Program::Program(const std::string s) {
     status = s;
     src = nullptr;
+    workers = nullptr;
+    chunkSize = 0;
+    layoutVertexSize = 0;
+    primitiveRestart = false;
+    instances = nullptr;
+    sizeofInstance = 0;
+    instanceVertices = 0;
+
+    // main runtime, then one for each worker
+    runtimes.push_back(new RuntimeIO);
+    runtimes.push_back(new RuntimeIO);
+}
+
+Pipeline::Program::~Program() {
+    delete workers;
+    for(uint32_t i = 0; i < runtimes.size(); ++i) {
+        delete runtimes[i];
+    }
+    for(uint32_t i = 0; i < states.size(); ++i) {
+        delete states[i];
+    }
+    for(uint32_t i = 0; i < streams.size(); ++i) {
+        delete streams[i];
+    }
 }
 
 
@@ -77,40 +110,481 @@ std::string Pipeline::Program::GetStatus() {
     return status;
 }
 
+void Pipeline::Program::SetWorkerCount(uint32_t count) {
+    if (count == GetWorkerCount()) return;
+
+    // the main runtime holds the stage input and the joined output,
+    // so each worker gets a runtime of its own on top of that.
+    if (!count) count = 1;
+    uint32_t numRuntimes = count+1;
+    delete workers;
+    workers = nullptr;
+    while(runtimes.size() > numRuntimes) {
+        delete runtimes[runtimes.size()-1];
+        runtimes.pop_back();
+    }
+    while(runtimes.size() < numRuntimes) {
+        runtimes.push_back(new RuntimeIO);
+    }
+    if (count > 1)
+        workers = new WorkerPool(count);
+}
+
+uint32_t Pipeline::Program::GetWorkerCount() const {
+    return workers ? workers->GetWorkerCount() : 1;
+}
+
+void Pipeline::Program::SetChunkSize(uint32_t size) {
+    chunkSize = size;
+}
+
+uint32_t Pipeline::Program::GetChunkSize() const {
+    return chunkSize;
+}
+
+void Pipeline::Program::SetVertexCacheSize(uint32_t entries) {
+    vertexCache.resize(entries);
+}
+
+uint32_t Pipeline::Program::GetVertexCacheSize() const {
+    return vertexCache.size();
+}
+
+void Pipeline::Program::SetPrimitiveRestart(bool enabled) {
+    primitiveRestart = enabled;
+}
+
+bool Pipeline::Program::GetPrimitiveRestart() const {
+    return primitiveRestart;
+}
+
+const Pipeline::Program::Statistics & Pipeline::Program::GetStatistics() const {
+    return stats;
+}
+
+void Pipeline::Program::ResetStatistics() {
+    stats = Statistics();
+}
+
+Pipeline::Program::Statistics::Statistics() {
+    indices = 0;
+    vertexInvocations = 0;
+}
+
+float Pipeline::Program::Statistics::GetVertexCacheHitRate() const {
+    if (!indices || vertexInvocations >= indices) return 0.f;
+    return 1.f - vertexInvocations / (float)indices;
+}
+
+void Pipeline::Program::UseVertexSize(uint32_t sizeofVertex) {
+    // slot locations only change with the size of the vertex
+    if (sizeofVertex == layoutVertexSize) return;
+    for(uint32_t i = 0; i < layouts.size(); ++i) {
+        layouts[i].Patch(sizeofVertex);
+    }
+    layoutVertexSize = sizeofVertex;
+}
+
 void Pipeline::Program::Run(
         Texture * framebuffer, 
+        DepthBuffer * depth,
         uint8_t * v, 
         uint32_t sizeofVertex,
-        uint32_t num) {
-    uint32_t currentSize;
-
-
-    std::stack<DataType> input;
-    static RuntimeIO runtimeIO;
+        uint32_t num,
+        const uint32_t * starts,
+        uint32_t numStarts) {
+
+    RuntimeIO & runtimeIO = *runtimes[0];
+    UseVertexSize(sizeofVertex);
+    restarts.assign(starts, starts + numStarts);
+    instances = nullptr;
+    instanceVertices = 0;
     
 
     #ifdef SR_PROGRAM_DIAGNOSTICS
         std::cout << SR_PD_header_c << "Starting Run: (" 
                   << cachedProcs.size() << " stages, vertex=" 
-                  << sizeofVertex << "Bytes)" << std::endl;
+                  << sizeofVertex << "Bytes, "
+                  << runtimes.size() << " workers)" << std::endl;
     #endif
 
 
-    runtimeIO.RunSetup(v, sizeofVertex, num, framebuffer);
+    if (chunkSize) {
+        RunStreamed(framebuffer, depth, v, sizeofVertex, num);
+        return;
+    }
+
+    runtimeIO.RunSetup(v, sizeofVertex, num, framebuffer, depth);
+    RunStages(0, nullptr, 0);
+}
+
+// The first stage is run over the vertices referred to by the indices,
+// then the next stage reads its results through an index table.
+// With restart, RestartIndex is honored even if primitive restart is disabled.
+void Pipeline::Program::RunIndexed(
+        Texture * framebuffer,
+        DepthBuffer * depth,
+        uint8_t * v,
+        uint32_t sizeofVertex,
+        const uint32_t * indices,
+        uint32_t numIndices,
+        bool restart) {
+
+    indices = RemoveRestarts(indices, numIndices, primitiveRestart || restart);
+    if (!numIndices) return;
+    RuntimeIO & runtimeIO = *runtimes[0];
+    instances = nullptr;
+    instanceVertices = 0;
+    UseVertexSize(sizeofVertex);
+    stats.indices += numIndices;
+
+    // streamed runs take their input as is, so the vertices are laid out in index order
+    if (chunkSize) {
+        expanded.resize(numIndices*sizeofVertex);
+        for(uint32_t i = 0; i < numIndices; ++i) {
+            memcpy(&expanded[i*sizeofVertex], v + indices[i]*sizeofVertex, sizeofVertex);
+        }
+        stats.vertexInvocations += numIndices;
+        RunStreamed(framebuffer, depth, &expanded[0], sizeofVertex, numIndices);
+        return;
+    }
+
+
+    if (cachedProcs.size() > 1 && cachedProcs[0]->IsOneToOne()) {
+        BuildIndexTable(indices, numIndices);
+        uint32_t numVertices = vertexList.size();
+
+        runtimeIO.RunSetupIndexed(v, sizeofVertex, &vertexList[0], numVertices, framebuffer, depth);
+        runtimeIO.NextProc(&layouts[0], states[0]);
+        cachedProcs[0]->NewRun(&runtimeIO);
+        if (cachedProcs[0]->GetPartitionCount(&runtimeIO) <= 1) {
+            RunStage(0);
+
+            // results are only where the index table expects them if every
+            // vertex produced exactly one output. Otherwise they are thrown out.
+            if (runtimeIO.commitCount == numVertices) {
+                stats.vertexInvocations += numVertices;
+                RunStages(1, &indexTable[0], numIndices);
+                return;
+            }
+        }
+    }
+
+    runtimeIO.RunSetupIndexed(v, sizeofVertex, indices, numIndices, framebuffer, depth);
+    stats.vertexInvocations += numIndices;
+    RunStages(0, nullptr, 0);
+}
+
+// The first stage reads the vertices through a table that repeats them 
+// for each instance, so they are only copied in once, or not at all when streamed.
+void Pipeline::Program::RunInstanced(
+        Texture * framebuffer,
+        DepthBuffer * depth,
+        uint8_t * v,
+        uint32_t sizeofVertex,
+        uint32_t num,
+        const uint8_t * instanceData,
+        uint32_t instanceSize,
+        uint32_t numInstances) {
+
+    if (!num || !numInstances) return;
+    RuntimeIO & runtimeIO = *runtimes[0];
+    UseVertexSize(sizeofVertex);
+    instances = instanceData;
+    sizeofInstance = instanceSize;
+    instanceVertices = num;
+
+    // strips and fans never continue from one instance into the next
+    restarts.clear();
+    for(uint32_t i = 1; i < numInstances; ++i) {
+        restarts.push_back(i*num);
+    }
+
+    // streamed runs read a chunk at a time from anywhere in the table (see RunStreamed()),
+    // so theirs only needs to go one chunk past the last vertex
+    uint32_t total = num*numInstances;
+    uint32_t tableSize = chunkSize ? std::min(total, num + chunkSize) : total;
+    instanceTable.resize(tableSize+1);
+    instanceTable[tableSize] = 0; // read past the last iteration, but never used
+    for(uint32_t i = 0; i < tableSize; ++i) {
+        instanceTable[i] = i % num;
+    }
+
+    if (chunkSize) {
+        RunStreamed(framebuffer, depth, v, sizeofVertex, total);
+        return;
+    }
+
+    runtimeIO.RunSetup(v, sizeofVertex, num, framebuffer, depth);
+    RunStages(0, &instanceTable[0], total);
+}
+
+// Runs the pipeline from the given stage onward. If given, the first
+// stage's iterations are mapped to its inputs through the indices.
+void Pipeline::Program::RunStages(uint32_t first, const uint32_t * indices, uint32_t numIndices) {
+    RuntimeIO & runtimeIO = *runtimes[0];
+    for(uint32_t i = first; i < cachedProcs.size(); ++i) {
+        if (i == first) {
+            runtimeIO.NextProc(&layouts[i], states[i], indices, numIndices);
+            runtimeIO.SetRestarts(restarts.empty() ? nullptr : &restarts[0], restarts.size(), 0);
+            if (!i) runtimeIO.SetInstances(instances, sizeofInstance, instanceVertices, 0);
+        } else {
+            runtimeIO.NextProc(&layouts[i], states[i]);
+            runtimeIO.SetInstances(nullptr, 0, 0, 0);
+        }
+        cachedProcs[i]->NewRun(&runtimeIO);
+
+        uint32_t numPartitions = cachedProcs[i]->GetPartitionCount(&runtimeIO);
+        if (numPartitions > 1) {
+            RunPartitions(i, numPartitions);
+            break;
+        }
+        RunStage(i);
+
+        // restarts only line up with the outputs of a stage that commits once per iteration
+        if (!KeepsRestarts(i, runtimeIO)) runtimeIO.SetRestarts(nullptr, 0, 0);
+    }
+}
+
+// Takes the restart indices out of the index list, noting the position
+// in what remains where each new strip or fan begins.
+const uint32_t * Pipeline::Program::RemoveRestarts(const uint32_t * indices, uint32_t & numIndices, bool restart) {
+    restarts.clear();
+    if (!restart || std::find(indices, indices + numIndices, RestartIndex) == indices + numIndices) 
+        return indices;
+
+    compacted.clear();
+    for(uint32_t i = 0; i < numIndices; ++i) {
+        if (indices[i] != RestartIndex) {
+            compacted.push_back(indices[i]);
+        } else if (restarts.empty() || restarts.back() != compacted.size()) {
+            restarts.push_back(compacted.size());
+        }
+    }
+    numIndices = compacted.size();
+    return compacted.empty() ? nullptr : &compacted[0];
+}
+
+// Fills vertexList with the vertices the first stage needs to run, 
+// and indexTable with where each index will find its result.
+void Pipeline::Program::BuildIndexTable(const uint32_t * indices, uint32_t numIndices) {
+    vertexList.clear();
+    indexTable.resize(numIndices+1);
+    indexTable[numIndices] = 0; // read past the last iteration, but never used
+
+    if (vertexCache.empty()) {
+        uint32_t numVertices = 0;
+        for(uint32_t i = 0; i < numIndices; ++i) {
+            numVertices = std::max(numVertices, indices[i]+1);
+        }
+        vertexSlots.assign(numVertices, UINT32_MAX);
+
+        for(uint32_t i = 0; i < numIndices; ++i) {
+            uint32_t & slot = vertexSlots[indices[i]];
+            if (slot == UINT32_MAX) {
+                slot = vertexList.size();
+                vertexList.push_back(indices[i]);
+            }
+            indexTable[i] = slot;
+        }
+        return;
+    }
+
+
+    for(uint32_t i = 0; i < vertexCache.size(); ++i) {
+        vertexCache[i].vertex = UINT32_MAX;
+        vertexCache[i].used = 0;
+    }
+    for(uint32_t i = 0; i < numIndices; ++i) {
+        CachedVertex * entry = &vertexCache[0];
+        for(uint32_t n = 0; n < vertexCache.size(); ++n) {
+            if (vertexCache[n].vertex == indices[i]) {
+                entry = &vertexCache[n];
+                break;
+            }
+            if (vertexCache[n].used < entry->used) entry = &vertexCache[n];
+        }
+
+        // miss: evict the least recently used
+        if (entry->vertex != indices[i]) {
+            entry->vertex = indices[i];
+            entry->slot = vertexList.size();
+            vertexList.push_back(indices[i]);
+        }
+        entry->used = i+1;
+        indexTable[i] = entry->slot;
+    }
+}
+
+// Each stage gets its own runtime. Input vertices are fed to the first
+// in chunks, and any stage whose output reaches the chunk size
+// has it run through the next stage right away (see Flush()).
+void Pipeline::Program::RunStreamed(
+        Texture * framebuffer,
+        DepthBuffer * depth,
+        uint8_t * v,
+        uint32_t sizeofVertex,
+        uint32_t num) {
+
+    while(streams.size() < cachedProcs.size()) {
+        streams.push_back(new RuntimeIO);
+    }
 
-    uint32_t numIters;
     for(uint32_t i = 0; i < cachedProcs.size(); ++i) {
-        runtimeIO.NextProc(cachedProcs[i]);
-        numIters = runtimeIO.GetIterationCount();
+        streams[i]->BeginStream(&layouts[i], states[i], sizeofVertex, framebuffer, depth, this, i, chunkSize);
+        cachedProcs[i]->NewRun(streams[i]);
+    }
 
-        for(uint32_t n = 0; n < numIters; ++n) {
-            (*cachedProcs[i])(&runtimeIO);
-            runtimeIO.NextIter();
+
+    // instanced runs read the same vertices for every instance, through instanceTable
+    RuntimeIO & first = *streams[0];
+    for(uint32_t n = 0; n < num; n += chunkSize) {
+        if (instanceVertices) {
+            first.Feed(v, std::min(chunkSize, num - n), &instanceTable[n % instanceVertices]);
+        } else {
+            first.Feed(v + n*sizeofVertex, std::min(chunkSize, num - n));
         }
+        first.SetRestarts(restarts.empty() ? nullptr : &restarts[0], restarts.size(), n);
+        first.SetInstances(instances, sizeofInstance, instanceVertices, n);
+        RunChunk(0);
+    }
 
+    // pass on whatever is left over, in pipeline order
+    for(uint32_t i = 0; i < cachedProcs.size(); ++i) {
+        if (streams[i]->commitCount) Flush(i);
+        streams[i]->EndStream();
+    }
+}
+
+void Pipeline::Program::RunChunk(uint32_t level) {
+    RuntimeIO & io = *streams[level];
+    StageProcedure * proc = cachedProcs[level];
+    io.RunBatch(proc, io.GetIterationCount());
+}
+
+// Runs the next stage over everything the given stage has committed so far
+void Pipeline::Program::Flush(uint32_t level) {
+    RuntimeIO & io = *streams[level];
+    if (level+1 < cachedProcs.size()) {
+        streams[level+1]->SetPrimitiveTable(io.primitiveTable, io.primitiveSize);
+        if (KeepsRestarts(level, io)) {
+            streams[level+1]->SetRestarts(io.restarts, io.numRestarts, io.restartBase);
+        } else {
+            streams[level+1]->SetRestarts(nullptr, 0, 0);
+        }
+        streams[level+1]->Feed(io.outputCache, io.commitCount);
+        RunChunk(level+1);
+    }
+    io.commitCount = 0;
+    io.outputCacheIter = io.outputCache;
+}
+
+// Whether the restarts of a stage's inputs also mark its outputs: only when
+// it declares one output per iteration (see StageProcedure::IsOneToOne()), 
+// and committed exactly that many
+bool Pipeline::Program::KeepsRestarts(uint32_t stage, const RuntimeIO & io) const {
+    return cachedProcs[stage]->IsOneToOne() && io.commitCount == io.procIterCount;
+}
+
+// Carries each partition of the given stage through the remainder of the pipeline. 
+void Pipeline::Program::RunPartitions(uint32_t stage, uint32_t count) {
+    RuntimeIO & runtimeIO = *runtimes[0];
+    uint32_t * numIterations = new uint32_t[count];
+    for(uint32_t i = 0; i < count; ++i) {
+        numIterations[i] = cachedProcs[stage]->GetPartitionIterations(&runtimeIO, i);
+    }
+
+    // later stages are set up against the main runtime once, 
+    // since they are run separately for each partition.
+    StageState * current = runtimeIO.state;
+    for(uint32_t i = stage+1; i < cachedProcs.size(); ++i) {
+        runtimeIO.state = states[i];
+        cachedProcs[i]->NewRun(&runtimeIO);
+    }
+    runtimeIO.state = current;
+
+    auto runPartition = [&](uint32_t worker, uint32_t partition) {
+        RuntimeIO * io = runtimes[worker+1];
+        StageProcedure * proc = cachedProcs[stage];
+
+        io->ShareStage(runtimeIO);
+        io->BeginPartition(partition, numIterations[partition]);
+        for(uint32_t i = stage; i < cachedProcs.size(); ++i) {
+            proc = cachedProcs[i];
+
+            // partitions reorder the outputs, so restarts no longer line up with them
+            if (i != stage) {
+                io->NextProc(&layouts[i], states[i]);
+                io->SetRestarts(nullptr, 0, 0);
+            }
+
+            io->RunBatch(proc, io->GetIterationCount());
+        }
+    };
+
+    if (workers) {
+        workers->Run(count, runPartition);
+    } else {
+        for(uint32_t i = 0; i < count; ++i) {
+            runPartition(0, i);
+        }
+    }
+    delete[] numIterations;
+}
+
+// Once a stage runs on a single thread, so do the stages after it: their
+// iterations come in an order (e.g. fragments of overlapping primitives, 
+// in the order drawn) that splitting them across workers would not keep.
+// Partitioned stages do not get here, and their partitions run whole on a worker.
+void Pipeline::Program::RunStage(uint32_t stage) {
+    RuntimeIO & runtimeIO = *runtimes[0];
+    StageProcedure * proc = cachedProcs[stage];
+    uint32_t numIters = runtimeIO.GetIterationCount();
+
+    bool parallel = true;
+    for(uint32_t i = 0; i <= stage; ++i) {
+        parallel = parallel && cachedProcs[i]->IsParallel();
+    }
+    if (!workers || !parallel || 
+        numIters < pipeline_program_min_chunk_iters * workers->GetWorkerCount()) {
+        runtimeIO.RunBatch(proc, numIters);
+        return;
+    }
+
+
+    // Each worker commits into its own cache. Chunks are joined
+    // back in order so that groups of consecutive outputs (i.e. the vertices
+    // of a primitive) stay together for the next stage.
+    struct Chunk {
+        uint32_t worker;
+        uint32_t offset;
+        uint32_t count;
+    };
+    uint32_t numWorkers = workers->GetWorkerCount();
+    for(uint32_t i = 0; i < numWorkers; ++i) {
+        runtimes[i+1]->ShareStage(runtimeIO);
     }
-    
 
+    uint32_t numChunks = numWorkers * pipeline_program_chunks_per_worker;
+    uint32_t itersPerChunk = (numIters + numChunks - 1) / numChunks;
+    numChunks = (numIters + itersPerChunk - 1) / itersPerChunk;
+    std::vector<Chunk> chunks(numChunks);
+
+    workers->Run(numChunks, [&](uint32_t worker, uint32_t chunk) {
+        RuntimeIO * io = runtimes[worker+1];
+        uint32_t first = chunk * itersPerChunk;
+        uint32_t last  = std::min(first + itersPerChunk, numIters);
+
+        chunks[chunk].worker = worker+1;
+        chunks[chunk].offset = io->commitCount;
+        io->SeekIteration(first);
+        io->RunBatch(proc, last - first);
+        chunks[chunk].count = io->commitCount - chunks[chunk].offset;
+    });
+
+    for(uint32_t i = 0; i < numChunks; ++i) {
+        runtimeIO.Gather(*runtimes[chunks[i].worker], chunks[i].offset, chunks[i].count);
+    }
 }
 
 
@@ -122,6 +596,32 @@ RuntimeIO::RuntimeIO() {
     outputCache = nullptr;
     inputCache = (uint8_t*)realloc(inputCache, inputCacheSize);
     outputCache = (uint8_t*)realloc(outputCache, outputCacheSize);
+    inputCacheIter = inputCache;
+    outputCacheIter = outputCache;
+    inputBlock = inputCache;
+    indexTable = nullptr;
+    commitCount = 0;
+    partition = 0;
+    state = nullptr;
+    depth = nullptr;
+    primitiveTable = nullptr;
+    primitiveSize = 0;
+    restarts = nullptr;
+    numRestarts = 0;
+    restartBase = 0;
+    restartCursor = 0;
+    instanceData = nullptr;
+    instanceSize = 0;
+    instanceVertices = 0;
+    instanceBase = 0;
+    stream = nullptr;
+    streamLevel = 0;
+    flushCount = UINT32_MAX;
+}
+
+RuntimeIO::~RuntimeIO() {
+    free(inputCache);
+    free(outputCache);
 }
 
 
@@ -129,7 +629,8 @@ void RuntimeIO::RunSetup(
     uint8_t * vData,
     uint32_t szVertex,
     uint32_t numIterations,
-    Texture * framebuffer
+    Texture * framebuffer,
+    DepthBuffer * depthBuffer
 ) {
     sizeofVertex = szVertex;
 
@@ -140,55 +641,43 @@ void RuntimeIO::RunSetup(
     PrepareOutputCache(szVertex*numIterations);
     memcpy(outputCache, vData, szVertex*numIterations);
     fb = framebuffer;
+    depth = depthBuffer;
+    SetPrimitiveTable(nullptr, 0);
+    SetRestarts(nullptr, 0, 0);
+    SetInstances(nullptr, 0, 0, 0);
 
 }
 
+// Same as RunSetup(), but the input vertices are the ones at the given positions of vData
+void RuntimeIO::RunSetupIndexed(
+    uint8_t * vData,
+    uint32_t szVertex,
+    const uint32_t * vertexList,
+    uint32_t numIterations,
+    Texture * framebuffer,
+    DepthBuffer * depthBuffer
+) {
+    sizeofVertex = szVertex;
+    commitCount = numIterations;
 
+    PrepareOutputCache(szVertex*numIterations);
+    for(uint32_t i = 0; i < numIterations; ++i) {
+        memcpy(outputCache + i*szVertex, vData + vertexList[i]*szVertex, szVertex);
+    }
+    fb = framebuffer;
+    depth = depthBuffer;
+    SetPrimitiveTable(nullptr, 0);
+    SetRestarts(nullptr, 0, 0);
+    SetInstances(nullptr, 0, 0, 0);
+}
 
-void RuntimeIO::NextProc(const StageProcedure * p) {
-    iterSlotIn = 0;
-    iterSlotOut = 0;
-    
-
-
-    // since we are dealing with a new proc,
-    // we need to correct our io signatures
-    argInLocs.clear();
-    argOutLocs.clear();
-
-    auto input  = p->InputSignature();
-    auto output = p->OutputSignature();
-   
-    inputSize  = SignatureSize(p->InputSignature(), sizeofVertex);
-    outputSize = SignatureSize(p->OutputSignature(), sizeofVertex);
 
-    auto iStack = input.Get();
-    argInLocs.push_back(0);
-    while(!iStack.empty()) {
-        argInLocs.push_back(
-            (argInLocs.empty() ? 
-                0
-            :                   
-                argInLocs[argInLocs.size() - 1]
-            )
-            + SizeOf(iStack.top())
-        ); 
-        iStack.pop();
-    }
 
-    auto oStack = output.Get();
-    argOutLocs.push_back(0);
-    while(!oStack.empty()) {
-        argOutLocs.push_back(
-            (argOutLocs.empty() ? 
-                0
-            :                   
-                argOutLocs[argOutLocs.size() - 1]
-            )
-            + SizeOf(oStack.top())
-        ); 
-        oStack.pop();
-    }
+void RuntimeIO::NextProc(const StageLayout * p, StageState * s, const uint32_t * indices, uint32_t numIndices) {
+    iterSlotIn = 0;
+    iterSlotOut = 0;
+    state = s;
+    SetLayout(p);
 
 
 
@@ -205,8 +694,13 @@ void RuntimeIO::NextProc(const StageProcedure * p) {
     std::swap(outputCache, inputCache);
     std::swap(outputCacheSize, inputCacheSize);
 
-    inputCacheIter = inputCache;
     outputCacheIter = outputCache;
+    inputBlock = inputCache;
+
+    // the last stage's output is read through the indices
+    indexTable = indices;
+    if (indexTable) procIterCount = numIndices;
+    inputCacheIter = InputAt(0);
 
     #ifdef SR_PROGRAM_DIAGNOSTICS
         std::cout << SR_PD_header_c << "Next stage: "
@@ -217,18 +711,148 @@ void RuntimeIO::NextProc(const StageProcedure * p) {
 }
 
 
+void RuntimeIO::SetLayout(const StageLayout * layout) {
+    argInLocs   = &layout->argInLocs[0];
+    argOutLocs  = &layout->argOutLocs[0];
+    argInCount  = layout->argInLocs.size()-1;
+    argOutCount = layout->argOutLocs.size()-1;
+    inputSize   = argInLocs[argInCount];
+    outputSize  = argOutLocs[argOutCount];
+}
+
+
+// Prepares this runtime to run the given stage over chunks fed by Feed().
+// Once flushCount outputs are committed, they are passed on through the 
+// owner's Flush().
+void RuntimeIO::BeginStream(
+    const StageLayout * p, 
+    StageState * s,
+    uint32_t szVertex,
+    Texture * framebuffer,
+    DepthBuffer * depthBuffer,
+    Pipeline::Program * owner,
+    uint32_t level,
+    uint32_t flushAt
+) {
+    sizeofVertex = szVertex;
+    fb           = framebuffer;
+    depth        = depthBuffer;
+    state        = s;
+    SetLayout(p);
+    SetPrimitiveTable(nullptr, 0);
+    SetRestarts(nullptr, 0, 0);
+    SetInstances(nullptr, 0, 0, 0);
+
+    indexTable      = nullptr;
+    stream          = owner;
+    streamLevel     = level;
+    flushCount      = flushAt;
+    procIterCount   = 0;
+    currentProcIter = 0;
+    commitCount     = 0;
+    iterSlotIn      = 0;
+    iterSlotOut     = 0;
+    outputCacheIter = outputCache;
+    PrepareOutputCache((flushCount+10)*outputSize);
+}
+
+// Points the input at the given records, which are owned elsewhere.
+// If given, iteration i reads the record at indices[i].
+void RuntimeIO::Feed(uint8_t * records, uint32_t count, const uint32_t * indices) {
+    inputBlock      = records;
+    indexTable      = indices;
+    inputCacheIter  = InputAt(0);
+    procIterCount   = count;
+    currentProcIter = 0;
+    iterSlotIn      = 0;
+}
+
+void RuntimeIO::EndStream() {
+    stream     = nullptr;
+    flushCount = UINT32_MAX;
+}
+
+
+
+// Runs count iterations of the proc from the current one. Afterwards, 
+// the iteration is always count past where it started, regardless of
+// how the proc went about it.
+void RuntimeIO::RunBatch(StageProcedure * proc, uint32_t count) {
+    uint32_t last = currentProcIter + count;
+    proc->Batch(this, count);
+
+    currentProcIter = last;
+    inputCacheIter  = InputAt(last);
+    iterSlotIn      = 0;
+    iterSlotOut     = 0;
+}
 
 void RuntimeIO::NextIter() {
     currentProcIter++;
     // want to reset the read iter in case user didnt
     // actually read in some args
-    inputCacheIter += inputSize;
+    inputCacheIter = InputAt(currentProcIter);
     iterSlotIn = 0;
     
 }
 
 
 
+// Mirrors the stage layout of the main runtime so that
+// this instance can run a chunk of its iterations.
+void RuntimeIO::ShareStage(const RuntimeIO & main) {
+    iterSlotIn   = 0;
+    iterSlotOut  = 0;
+    inputSize    = main.inputSize;
+    outputSize   = main.outputSize;
+    sizeofVertex = main.sizeofVertex;
+    argInLocs    = main.argInLocs;
+    argOutLocs   = main.argOutLocs;
+    argInCount   = main.argInCount;
+    argOutCount  = main.argOutCount;
+    fb           = main.fb;
+    depth        = main.depth;
+    state        = main.state;
+    SetPrimitiveTable(main.primitiveTable, main.primitiveSize);
+    SetRestarts(main.restarts, main.numRestarts, main.restartBase);
+    SetInstances(main.instanceData, main.instanceSize, main.instanceVertices, main.instanceBase);
+
+    procIterCount   = main.procIterCount;
+    currentProcIter = 0;
+    commitCount     = 0;
+    partition       = 0;
+    outputCacheIter = outputCache;
+    inputBlock      = main.inputBlock;
+    indexTable      = main.indexTable;
+    inputCacheIter  = InputAt(0);
+}
+
+// Iterations of a partition have no input of their own;
+// the stage reads what it needs through GetReadPointer(uint32_t)
+void RuntimeIO::BeginPartition(uint32_t p, uint32_t numIterations) {
+    partition       = p;
+    procIterCount   = numIterations;
+    currentProcIter = 0;
+}
+
+// Points the input shared by ShareStage() at the given iteration.
+// Iteration indices stay global so that GetCurrentIteration() 
+// is the same regardless of which worker runs it.
+void RuntimeIO::SeekIteration(uint32_t iter) {
+    currentProcIter = iter;
+    inputCacheIter  = InputAt(iter);
+    iterSlotIn      = 0;
+}
+
+// Appends count outputs committed by the other runtime, starting at its first'th output
+void RuntimeIO::Gather(const RuntimeIO & other, uint32_t first, uint32_t count) {
+    if (!count) return;
+    PrepareOutputCache((commitCount + count + 1) * outputSize);
+    memcpy(outputCacheIter, other.outputCache + first*outputSize, count*outputSize);
+    outputCacheIter += count*outputSize;
+    commitCount += count;
+}
+
 void RuntimeIO::PrepareInputCache(uint32_t b) {
     if (b < inputCacheSize) return;
 
@@ -252,57 +876,123 @@ void RuntimeIO::Commit() {
     PrepareOutputCache((commitCount+10)*outputSize);
     outputCacheIter += outputSize;
     iterSlotOut = 0;
+
+    if (commitCount >= flushCount)
+        stream->Flush(streamLevel);
 }
 
-uint32_t RuntimeIO::SizeOf(DataType type) {
-    switch(type) {
-        case DataType::Null:    return 0;
-        case DataType::Float:   return sizeof(float);
-        case DataType::Int:     return sizeof(int);     
-        case DataType::Vector2: return sizeof(Vector2); 
-        case DataType::Vector3: return sizeof(Vector3); 
-        case DataType::Vector4: return sizeof(Vector4); 
-        case DataType::Mat4:    return sizeof(Mat4); 
-        case DataType::Fragment:return sizeof(Fragment);
-        case DataType::UserVertex:
-            return sizeofVertex;
-        default: assert(!"Could not determine size of variable..");
-        break;
+uint8_t * RuntimeIO::GetWriteSpan(uint32_t count) {
+    PrepareOutputCache((commitCount+count+10)*outputSize);
+    return outputCacheIter;
+}
+
+void RuntimeIO::CommitSpan(uint32_t count) {
+    commitCount += count;
+    outputCacheIter += count*outputSize;
+    iterSlotOut = 0;
+
+    if (commitCount >= flushCount)
+        stream->Flush(streamLevel);
+}
+
+void RuntimeIO::SetPrimitiveTable(const uint8_t * table, uint32_t sizeofPrimitive) {
+    primitiveTable = table;
+    primitiveSize = sizeofPrimitive;
+}
+
+void RuntimeIO::SetRestarts(const uint32_t * positions, uint32_t count, uint32_t base) {
+    restarts = positions;
+    numRestarts = count;
+    restartBase = base;
+    restartCursor = 0;
+}
+
+void RuntimeIO::SetInstances(const uint8_t * data, uint32_t sizeofInstance, uint32_t verticesPerInstance, uint32_t base) {
+    instanceData = data;
+    instanceSize = sizeofInstance;
+    instanceVertices = verticesPerInstance;
+    instanceBase = base;
+}
+
+// Stages mostly ask about iterations in order, so the search
+// carries on from the last restart passed.
+bool RuntimeIO::FindRestart(uint32_t iteration) const {
+    uint32_t position = restartBase + iteration;
+    if (restartCursor && restarts[restartCursor-1] >= position) {
+        restartCursor = std::lower_bound(restarts, restarts + numRestarts, position) - restarts;
     }
-    return 0;
+    while(restartCursor < numRestarts && restarts[restartCursor] < position) {
+        restartCursor++;
+    }
+    return restartCursor < numRestarts && restarts[restartCursor] == position;
 }
 
+uint32_t RuntimeIO::SizeOf(DataType type) {
+    if (type == DataType::UserVertex) return sizeofVertex;
+    return FixedSizeOf(type);
+}
 
 
 
 
 
-///// Statics//////
-uint32_t SignatureSize(const StageProcedure::SignatureIO & sig, uint32_t sizeofVertex) {
+/////// StageLayout
+static void BuildLocations(
+    const StageProcedure::SignatureIO & sig, 
+    std::vector<uint32_t> & fixed, 
+    std::vector<uint32_t> & vertices,
+    std::vector<uint32_t> & locs) {
 
     std::stack<DataType> stk = sig.Get();
-    uint32_t size = 0;
+    fixed.clear();
+    vertices.clear();
+    fixed.push_back(0);
+    vertices.push_back(0);
     while(!stk.empty()) {
-        switch(stk.top()) {
-            case DataType::Null: break; 
-            case DataType::Float:   size += sizeof(float);   break;
-            case DataType::Int:     size += sizeof(int);     break;
-            case DataType::Vector2: size += sizeof(Vector2); break;
-            case DataType::Vector3: size += sizeof(Vector3); break;
-            case DataType::Vector4: size += sizeof(Vector4); break;
-            case DataType::Mat4:    size += sizeof(Mat4);    break;
-            case DataType::Fragment:size += sizeof(Fragment);break;
-            case DataType::UserVertex:
-                size += sizeofVertex; break;
-            default: assert(!"Could not determine size of variable..");
-            break;
-        }
+        fixed.push_back(fixed[fixed.size()-1] + FixedSizeOf(stk.top()));
+        vertices.push_back(vertices[vertices.size()-1] + (stk.top() == DataType::UserVertex ? 1 : 0));
         stk.pop();
     }
-    return size;
+    locs.resize(fixed.size());
 }
 
+void StageLayout::Build(const StageProcedure * p) {
+    BuildLocations(p->InputSignature(),  inFixed,  inVertices,  argInLocs);
+    BuildLocations(p->OutputSignature(), outFixed, outVertices, argOutLocs);
+    Patch(0);
+}
+
+void StageLayout::Patch(uint32_t sizeofVertex) {
+    for(uint32_t i = 0; i < argInLocs.size(); ++i) {
+        argInLocs[i] = inFixed[i] + inVertices[i]*sizeofVertex;
+    }
+    for(uint32_t i = 0; i < argOutLocs.size(); ++i) {
+        argOutLocs[i] = outFixed[i] + outVertices[i]*sizeofVertex;
+    }
+}
 
 
 
 
+
+
+///// Statics//////
+uint32_t FixedSizeOf(DataType type) {
+    switch(type) {
+        case DataType::Null:    return 0;
+        case DataType::Float:   return sizeof(float);
+        case DataType::Int:     return sizeof(int);     
+        case DataType::Vector2: return sizeof(Vector2); 
+        case DataType::Vector3: return sizeof(Vector3); 
+        case DataType::Vector4: return sizeof(Vector4); 
+        case DataType::Mat4:    return sizeof(Mat4); 
+        case DataType::Fragment:return sizeof(Fragment);
+        case DataType::Span:    return sizeof(Span);
+        case DataType::PrimitiveID: return sizeof(uint32_t);
+        case DataType::UserVertex:
+            return 0;
+        default: assert(!"Could not determine size of variable..");
+        break;
+    }
+    return 0;
+}
@@ -0,0 +1,81 @@
+#ifndef H_SOFTRASTER_PRIMITIVE_ASSEMBLY_INCLUDED
+#define H_SOFTRASTER_PRIMITIVE_ASSEMBLY_INCLUDED
+
+/* SoftRaster: PrimitiveAssembly (internal)
+   Johnathan Corkery, 2015 */
+#include <SoftRaster/Primitives.h>
+#include <cstdint>
+#include <utility>
+
+namespace SoftRaster {
+
+// Decides which vertices make up each primitive as the vertices of a 
+// list, strip or fan come in one at a time. Vertices are referred to by
+// handles of the caller's choosing, such as iterations or storage slots.
+// Points are always assembled as a list.
+struct PrimitiveAssembly {
+    PrimitiveAssembly(Topology t = Topology::List, uint32_t count = 3) {
+        topology = count > 1 ? t : Topology::List;
+        vertexCount = count;
+        Restart();
+    }
+
+    // Starts a new strip or fan, dropping any vertices held so far.
+    void Restart() {
+        held = 0;
+        run = 0;
+    }
+
+    // Adds the next vertex. Returns whether it completes a primitive, 
+    // in which case out holds the handles of its vertices in order.
+    bool Add(uint32_t handle, uint32_t out[3]) {
+        if (held+1 < vertexCount) {
+            vertices[held++] = handle;
+            return false;
+        }
+        for(uint32_t i = 0; i < held; ++i) {
+            out[i] = vertices[i];
+        }
+        out[held] = handle;
+
+        switch(topology) {
+          case Topology::List:
+            held = 0;
+            break;
+
+          case Topology::Strip:
+            if (vertexCount == 3) {
+                if (run & 1) std::swap(out[0], out[1]);
+                vertices[0] = vertices[1];
+            }
+            vertices[vertexCount-2] = handle;
+            break;
+
+          case Topology::Fan:
+            if (vertexCount == 3) vertices[1] = handle;
+            break;
+        }
+        run++;
+        return true;
+    }
+
+    // Returns the first of base, base+1 and base+2 that is not held
+    // for later primitives. For callers that copy each vertex into one of 3 slots.
+    uint32_t FreeSlot(uint32_t base = 0) const {
+        uint32_t slot = base;
+        while((held > 0 && vertices[0] == slot) || (held > 1 && vertices[1] == slot)) {
+            slot++;
+        }
+        return slot;
+    }
+
+    Topology topology;
+    uint32_t vertexCount;
+    uint32_t vertices[2]; // handles held for the next primitives
+    uint32_t held;
+    uint32_t run;         // primitives since the last restart
+};
+
+}
+
+#endif
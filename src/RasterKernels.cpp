@@ -0,0 +1,245 @@
+#include "RasterKernels.h"
+
+// The vector kernels are compiled for their instruction sets on a per-function
+// basis and only called if the CPU reports support, so the library itself
+// does not need to be built for any particular instruction set.
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+    #define SR_RASTER_KERNELS_X86
+    #include <immintrin.h>
+#endif
+
+using namespace SoftRaster;
+
+
+static uint32_t RowKernel_Scalar(const EdgeRow &, uint32_t, float bias[3][raster_kernel_max_width]);
+static void VaryingKernel_Scalar(const VaryingPlanes &, uint32_t, const float * const bias[3], float out[][raster_kernel_max_width]);
+#ifdef SR_RASTER_KERNELS_X86
+static uint32_t RowKernel_SSE2  (const EdgeRow &, uint32_t, float bias[3][raster_kernel_max_width]);
+static uint32_t RowKernel_AVX2  (const EdgeRow &, uint32_t, float bias[3][raster_kernel_max_width]);
+static uint32_t RowKernel_AVX512(const EdgeRow &, uint32_t, float bias[3][raster_kernel_max_width]);
+static void VaryingKernel_SSE2(const VaryingPlanes &, uint32_t, const float * const bias[3], float out[][raster_kernel_max_width]);
+static void VaryingKernel_AVX2(const VaryingPlanes &, uint32_t, const float * const bias[3], float out[][raster_kernel_max_width]);
+#endif
+
+
+struct KernelChoice {
+    KernelChoice() {
+        kernel = RowKernel_Scalar;
+        varying = VaryingKernel_Scalar;
+        name = "Scalar";
+      #ifdef SR_RASTER_KERNELS_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f")) {
+            kernel = RowKernel_AVX512;
+            varying = VaryingKernel_AVX2; // 8 floats already fill a row
+            name = "AVX-512";
+        } else if (__builtin_cpu_supports("avx2")) {
+            kernel = RowKernel_AVX2;
+            varying = VaryingKernel_AVX2;
+            name = "AVX2";
+        } else if (__builtin_cpu_supports("sse2")) {
+            kernel = RowKernel_SSE2;
+            varying = VaryingKernel_SSE2;
+            name = "SSE2";
+        }
+      #endif
+    }
+
+    RowKernel kernel;
+    VaryingKernel varying;
+    const char * name;
+};
+
+static const KernelChoice & GetChoice() {
+    static KernelChoice choice;
+    return choice;
+}
+
+RowKernel SoftRaster::GetRowKernel(bool vectorized) {
+    return vectorized ? GetChoice().kernel : RowKernel_Scalar;
+}
+
+VaryingKernel SoftRaster::GetVaryingKernel(bool vectorized) {
+    return vectorized ? GetChoice().varying : VaryingKernel_Scalar;
+}
+
+const char * SoftRaster::GetRowKernelName() {
+    return GetChoice().name;
+}
+
+
+
+
+///// Statics//////
+uint32_t RowKernel_Scalar(const EdgeRow & row, uint32_t count, float bias[3][raster_kernel_max_width]) {
+    int64_t e0 = row.e[0];
+    int64_t e1 = row.e[1];
+    int64_t e2 = row.e[2];
+    uint32_t mask = 0;
+    for(uint32_t i = 0; i < count; ++i) {
+        if ((e0 | e1 | e2) >= 0) mask |= 1 << i;
+        bias[0][i] = (e0 - row.fill[0]) * row.invArea;
+        bias[1][i] = (e1 - row.fill[1]) * row.invArea;
+        bias[2][i] = (e2 - row.fill[2]) * row.invArea;
+
+        e0 += row.stepX[0];
+        e1 += row.stepX[1];
+        e2 += row.stepX[2];
+    }
+    return mask;
+}
+
+void VaryingKernel_Scalar(const VaryingPlanes & planes, uint32_t count, const float * const bias[3], float out[][raster_kernel_max_width]) {
+    for(uint32_t i = 0; i < count; ++i) {
+        float b0 = bias[0][i];
+        float b1 = bias[1][i];
+        float b2 = bias[2][i];
+        float scale = 1.f;
+        if (planes.perspective) {
+            scale = 1.f / (b0*planes.invW[0] + b1*planes.invW[1] + b2*planes.invW[2]);
+        }
+        for(uint32_t n = 0; n < planes.count; ++n) {
+            const float * v = planes.values[n];
+            out[n][i] = (b0*v[0] + b1*v[1] + b2*v[2]) * scale;
+        }
+    }
+}
+
+
+
+
+#ifdef SR_RASTER_KERNELS_X86
+
+// Edge values stay well within the 53 bits a double holds exactly (see the
+// guard band of the rasterizer), so evaluating them as doubles is exact.
+// Converting them to float then rounds the same as converting the integers,
+// and the sign bit is set for exactly the negative values.
+
+__attribute__((target("sse2")))
+uint32_t RowKernel_SSE2(const EdgeRow & row, uint32_t count, float bias[3][raster_kernel_max_width]) {
+    const __m128 invArea = _mm_set1_ps(row.invArea);
+    __m128d any0 = _mm_setzero_pd();
+    __m128d any1 = _mm_setzero_pd();
+    __m128d any2 = _mm_setzero_pd();
+    __m128d any3 = _mm_setzero_pd();
+    for(uint32_t k = 0; k < 3; ++k) {
+        __m128d step = _mm_set1_pd((double)(row.stepX[k] * 2));
+        __m128d fill = _mm_set1_pd((double)row.fill[k]);
+        __m128d e0 = _mm_set_pd((double)(row.e[k] + row.stepX[k]), (double)row.e[k]);
+        __m128d e1 = _mm_add_pd(e0, step);
+        __m128d e2 = _mm_add_pd(e1, step);
+        __m128d e3 = _mm_add_pd(e2, step);
+        any0 = _mm_or_pd(any0, e0);
+        any1 = _mm_or_pd(any1, e1);
+        any2 = _mm_or_pd(any2, e2);
+        any3 = _mm_or_pd(any3, e3);
+
+        __m128 lo = _mm_movelh_ps(_mm_cvtpd_ps(_mm_sub_pd(e0, fill)), _mm_cvtpd_ps(_mm_sub_pd(e1, fill)));
+        __m128 hi = _mm_movelh_ps(_mm_cvtpd_ps(_mm_sub_pd(e2, fill)), _mm_cvtpd_ps(_mm_sub_pd(e3, fill)));
+        _mm_storeu_ps(bias[k],   _mm_mul_ps(lo, invArea));
+        _mm_storeu_ps(bias[k]+4, _mm_mul_ps(hi, invArea));
+    }
+    uint32_t mask = _mm_movemask_pd(any0)        | (_mm_movemask_pd(any1) << 2) | 
+                   (_mm_movemask_pd(any2) << 4) | (_mm_movemask_pd(any3) << 6);
+    return ~mask & ((1 << count) - 1);
+}
+
+
+__attribute__((target("avx2")))
+uint32_t RowKernel_AVX2(const EdgeRow & row, uint32_t count, float bias[3][raster_kernel_max_width]) {
+    const __m256d lanes = _mm256_set_pd(3, 2, 1, 0);
+    const __m256  invArea = _mm256_set1_ps(row.invArea);
+    __m256d anyLo = _mm256_setzero_pd();
+    __m256d anyHi = _mm256_setzero_pd();
+    for(uint32_t k = 0; k < 3; ++k) {
+        __m256d step = _mm256_set1_pd((double)row.stepX[k]);
+        __m256d fill = _mm256_set1_pd((double)row.fill[k]);
+        __m256d lo = _mm256_add_pd(_mm256_set1_pd((double)row.e[k]), _mm256_mul_pd(lanes, step));
+        __m256d hi = _mm256_add_pd(lo, _mm256_mul_pd(_mm256_set1_pd(4), step));
+        anyLo = _mm256_or_pd(anyLo, lo);
+        anyHi = _mm256_or_pd(anyHi, hi);
+
+        __m256 b = _mm256_set_m128(
+            _mm256_cvtpd_ps(_mm256_sub_pd(hi, fill)),
+            _mm256_cvtpd_ps(_mm256_sub_pd(lo, fill))
+        );
+        _mm256_storeu_ps(bias[k], _mm256_mul_ps(b, invArea));
+    }
+    uint32_t mask = _mm256_movemask_pd(anyLo) | (_mm256_movemask_pd(anyHi) << 4);
+    return ~mask & ((1 << count) - 1);
+}
+
+
+__attribute__((target("avx512f")))
+uint32_t RowKernel_AVX512(const EdgeRow & row, uint32_t count, float bias[3][raster_kernel_max_width]) {
+    const __m512d lanes = _mm512_set_pd(7, 6, 5, 4, 3, 2, 1, 0);
+    const __m256  invArea = _mm256_set1_ps(row.invArea);
+    __m512i any = _mm512_setzero_si512();
+    for(uint32_t k = 0; k < 3; ++k) {
+        __m512d e = _mm512_add_pd(_mm512_set1_pd((double)row.e[k]), _mm512_mul_pd(lanes, _mm512_set1_pd((double)row.stepX[k])));
+        any = _mm512_or_si512(any, _mm512_castpd_si512(e));
+
+        // the masked form converts the same, but does not leave its passthrough undefined
+        __m256 b = _mm512_mask_cvtpd_ps(_mm256_setzero_ps(), 0xFF, _mm512_sub_pd(e, _mm512_set1_pd((double)row.fill[k])));
+        b = _mm256_mul_ps(b, invArea);
+        _mm256_storeu_ps(bias[k], b);
+    }
+    uint32_t mask = ~(uint32_t)_mm512_cmplt_epi64_mask(any, _mm512_setzero_si512());
+    return mask & ((1 << count) - 1);
+}
+
+
+// Varying kernels always evaluate the full row; pixels past count are never read. 
+// Multiplies and adds are kept separate and in the same order as the scalar 
+// kernel so that results match exactly.
+
+__attribute__((target("sse2")))
+void VaryingKernel_SSE2(const VaryingPlanes & planes, uint32_t, const float * const bias[3], float out[][raster_kernel_max_width]) {
+    for(uint32_t half = 0; half < raster_kernel_max_width; half += 4) {
+        __m128 b0 = _mm_loadu_ps(bias[0] + half);
+        __m128 b1 = _mm_loadu_ps(bias[1] + half);
+        __m128 b2 = _mm_loadu_ps(bias[2] + half);
+        __m128 scale = _mm_set1_ps(1.f);
+        if (planes.perspective) {
+            __m128 q = _mm_add_ps(_mm_add_ps(
+                _mm_mul_ps(b0, _mm_set1_ps(planes.invW[0])), 
+                _mm_mul_ps(b1, _mm_set1_ps(planes.invW[1]))),
+                _mm_mul_ps(b2, _mm_set1_ps(planes.invW[2])));
+            scale = _mm_div_ps(scale, q);
+        }
+        for(uint32_t n = 0; n < planes.count; ++n) {
+            const float * v = planes.values[n];
+            __m128 value = _mm_add_ps(_mm_add_ps(
+                _mm_mul_ps(b0, _mm_set1_ps(v[0])), 
+                _mm_mul_ps(b1, _mm_set1_ps(v[1]))),
+                _mm_mul_ps(b2, _mm_set1_ps(v[2])));
+            _mm_storeu_ps(out[n] + half, _mm_mul_ps(value, scale));
+        }
+    }
+}
+
+
+__attribute__((target("avx2")))
+void VaryingKernel_AVX2(const VaryingPlanes & planes, uint32_t, const float * const bias[3], float out[][raster_kernel_max_width]) {
+    __m256 b0 = _mm256_loadu_ps(bias[0]);
+    __m256 b1 = _mm256_loadu_ps(bias[1]);
+    __m256 b2 = _mm256_loadu_ps(bias[2]);
+    __m256 scale = _mm256_set1_ps(1.f);
+    if (planes.perspective) {
+        __m256 q = _mm256_add_ps(_mm256_add_ps(
+            _mm256_mul_ps(b0, _mm256_set1_ps(planes.invW[0])), 
+            _mm256_mul_ps(b1, _mm256_set1_ps(planes.invW[1]))),
+            _mm256_mul_ps(b2, _mm256_set1_ps(planes.invW[2])));
+        scale = _mm256_div_ps(scale, q);
+    }
+    for(uint32_t n = 0; n < planes.count; ++n) {
+        const float * v = planes.values[n];
+        __m256 value = _mm256_add_ps(_mm256_add_ps(
+            _mm256_mul_ps(b0, _mm256_set1_ps(v[0])), 
+            _mm256_mul_ps(b1, _mm256_set1_ps(v[1]))),
+            _mm256_mul_ps(b2, _mm256_set1_ps(v[2])));
+        _mm256_storeu_ps(out[n], _mm256_mul_ps(value, scale));
+    }
+}
+
+#endif
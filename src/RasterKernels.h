@@ -0,0 +1,66 @@
+#ifndef H_SOFTRASTER_RASTER_KERNELS_INCLUDED
+#define H_SOFTRASTER_RASTER_KERNELS_INCLUDED
+
+/* SoftRaster: RasterKernels (internal)
+   Johnathan Corkery, 2015 */
+#include <cstdint>
+
+namespace SoftRaster {
+
+// Widest row of pixels a kernel is given at once.
+const uint32_t raster_kernel_max_width = 8;
+
+// Most float attributes a rasterizer interpolates.
+const uint32_t raster_max_varyings = 16;
+
+
+// Edge functions of a triangle along a row of pixels.
+// Values are in the fixed-point units of the edge function rasterizer,
+// at the first pixel and already adjusted by the fill rule.
+struct EdgeRow {
+    int64_t e[3];
+    int64_t stepX[3];
+    int64_t fill[3];
+    float invArea;
+};
+
+
+// Tests count consecutive pixels of a row against the edges and writes
+// the biases of every pixel (covered or not) to bias[edge][pixel].
+// Returns the coverage mask, where bit i is set if pixel i is covered.
+//
+// Every kernel gives the same results as the scalar one, bit for bit.
+typedef uint32_t (*RowKernel)(const EdgeRow &, uint32_t count, float bias[3][raster_kernel_max_width]);
+
+
+// Float attributes of a primitive as planes over the biases towards its vertices.
+// With perspective, values are already divided by the w of their vertex, and 
+// the interpolated values are divided by the interpolated 1/w.
+struct VaryingPlanes {
+    uint32_t count;
+    bool perspective;
+    float invW[3];
+    float values[raster_max_varyings][3];
+};
+
+
+// Interpolates every varying for count consecutive pixels, given the bias
+// of each pixel towards each vertex (in vertex order). Writes out[varying][pixel].
+//
+// Every kernel gives the same results as the scalar one, bit for bit.
+typedef void (*VaryingKernel)(const VaryingPlanes &, uint32_t count, const float * const bias[3], float out[][raster_kernel_max_width]);
+
+
+// Returns the widest kernel supported by the running CPU,
+// or the scalar kernel if not vectorized.
+RowKernel GetRowKernel(bool vectorized);
+
+// Same as GetRowKernel(), for varyings.
+VaryingKernel GetVaryingKernel(bool vectorized);
+
+// Returns the name of the instruction set used by GetRowKernel(true).
+const char * GetRowKernelName();
+
+}
+
+#endif
@@ -0,0 +1,77 @@
+#include <SoftRaster/Sampler.h>
+#include "TextureKernels.h"
+#include <algorithm>
+
+using namespace SoftRaster;
+
+
+
+Sampler::Sampler(Texture::SampleRule filter_, Wrap wrap) :
+          filter (filter_),
+          wrapU  (wrap),
+          wrapV  (wrap) {
+}
+
+
+void Sampler::SetFilter(Texture::SampleRule s) {
+    filter = s;
+}
+
+void Sampler::SetWrap(Wrap w) {
+    wrapU = wrapV = w;
+}
+
+void Sampler::SetWrap(Wrap u, Wrap v) {
+    wrapU = u;
+    wrapV = v;
+}
+
+
+
+void Sampler::Sample(const Texture * t, float u, float v, uint8_t * pixel) const {
+    Sample(t, u, v, 0.f, pixel);
+}
+
+void Sampler::Sample(const Texture * t, float u, float v, float lod, uint8_t * pixel) const {
+    SampleParams params;
+    Prepare(t, lod, params);
+    GetSampleKernel(false)(params, &u, &v, 1, pixel);
+}
+
+void Sampler::SampleBatch(const Texture * t, const float * u, const float * v, uint32_t count, float lod, uint8_t * pixels) const {
+    SampleParams params;
+    Prepare(t, lod, params);
+    GetSampleKernel(true)(params, u, v, count, pixels);
+}
+
+
+
+// Picks the levels to read for the level of detail. Levels past
+// the last one read the last one.
+void Sampler::Prepare(const Texture * t, float lod, SampleParams & params) const {
+    const uint32_t last = t->GetMipmapCount() - 1;
+    const Texture * levels[2] = {t, t};
+    params.blend = 0.f;
+    if (filter == Texture::SampleRule::Trilinear) {
+        if (lod > 0.f) {
+            uint32_t fine = lod < last ? (uint32_t)lod : last;
+            levels[0] = t->GetMipmap(fine);
+            if (fine < last) {
+                levels[1] = t->GetMipmap(fine + 1);
+                params.blend = lod - fine;
+            }
+        }
+    } else if (lod > .5f) {
+        levels[0] = t->GetMipmap(lod < last ? std::min((uint32_t)(lod + .5f), last) : last);
+    }
+
+    for(int i = 0; i < 2; ++i) {
+        params.levels[i].data   = levels[i]->data;
+        params.levels[i].w      = levels[i]->w;
+        params.levels[i].h      = levels[i]->h;
+        params.levels[i].tilesX = levels[i]->layout == Texture::Layout::Tiled ? levels[i]->tilesX : 0;
+    }
+    params.bilinear = filter != Texture::SampleRule::Basic;
+    params.wrapU = wrapU;
+    params.wrapV = wrapV;
+}
@@ -2,6 +2,13 @@
 
 using namespace SoftRaster;
 
+void StageProcedure::Batch(RuntimeIO * io, uint32_t count) {
+    for(uint32_t i = 0; i < count; ++i) {
+        (*this)(io);
+        io->NextIter();
+    }
+}
+
 StageProcedure::SignatureIO::SignatureIO(const std::vector<DataType> & l) {
     types = l;
 }
@@ -1,16 +1,15 @@
 #include <SoftRaster/Texture.h>
+#include <SoftRaster/Sampler.h>
+#include "BlendKernels.h"
+#include "TextureKernels.h"
 #include <algorithm>
+#include <cmath>
+#include <vector>
 
 using namespace SoftRaster;
 
-static uint8_t * ColorAdd_None    (const uint8_t *, const uint8_t *);
-static uint8_t * ColorAdd_Alpha   (const uint8_t *, const uint8_t *);
-static uint8_t * ColorAdd_Additive(const uint8_t *, const uint8_t *);
 
-
-
-static uint8_t * SampleRule_Basic(uint16_t, uint16_t, Texture *);
-static uint8_t * SampleRule_LI(uint16_t, uint16_t, Texture *);
+static void CopyRow(uint8_t * linearRow, uint8_t * tiled, uint16_t w, uint16_t y, bool toTiled);
 
 
 struct Color32 {uint8_t r; uint8_t g; uint8_t b; uint8_t a;};
@@ -23,29 +22,37 @@ Texture::Texture(uint16_t w_, uint16_t h_, uint8_t * data_) {
     }
     w = w_;
     h = h_;
-    carule = ColorAdd_Alpha;
-    sarule = SampleRule_Basic;
+    layout = Layout::Linear;
+    tilesX = (w + TileSize - 1) / TileSize;
+    SetBlendRule(ColorAddRule::Alpha);
+    sarule = SampleRule::Basic;
 }
 
 Texture::Texture(const Texture & t) {
+    data = nullptr;
     *this = t;
 }
 
 Texture::~Texture() {
     delete[] data;
+    ClearMipmaps();
 }
 
 
 
 
 void Texture::Resize(uint16_t newWidth, uint16_t newHeight) {
+    // rows are copied over as linear, then stored as before
+    Layout oldLayout = layout;
+    ClearMipmaps();
+    SetLayout(Layout::Linear);
     uint8_t * newData = new uint8_t[newWidth * newHeight * 4];
 
     // careful not to exceed any limits;
     uint16_t limitHeight = std::min(newHeight, h);
     uint16_t limitWidth  = std::min(newWidth, w);
     for(uint16_t y = 0; y < limitHeight; ++y) {
-        memcpy(newData+newWidth*y, data, limitWidth);
+        memcpy(newData+newWidth*y*4, data+w*y*4, limitWidth*4);
     }
 
 
@@ -53,15 +60,19 @@ void Texture::Resize(uint16_t newWidth, uint16_t newHeight) {
     data = newData;
     w = newWidth;
     h = newHeight;
+    tilesX = (w + TileSize - 1) / TileSize;
+    SetLayout(oldLayout);
 }
 
 
 
 void Texture::ResizeFast(uint16_t newWidth, uint16_t newHeight) {
+    ClearMipmaps();
     delete[]data;
-    data = new uint8_t[newWidth*newHeight*4];
     w = newWidth;
     h = newHeight;
+    tilesX = (w + TileSize - 1) / TileSize;
+    data = new uint8_t[StorageSize(layout)];
 }
 
 
@@ -69,73 +80,183 @@ Texture & Texture::operator=(const Texture & t) {
     delete[] data;
     w = t.w;
     h = t.h;
+    layout = t.layout;
+    tilesX = t.tilesX;
     carule = t.carule;
+    spanrule = t.spanrule;
     sarule = t.sarule;
-    data = new uint8_t[w*h*4];
-    memcpy(data, t.data, w*h*4);
+    data = new uint8_t[StorageSize(layout)];
+    memcpy(data, t.data, StorageSize(layout));
+    ClearMipmaps();
+    for(uint32_t i = 0; i < t.mipmaps.size(); ++i) {
+        mipmaps.push_back(new Texture(*t.mipmaps[i]));
+    }
     return *this;
 }   
 
 
+void Texture::SetLayout(Layout l) {
+    if (l == layout) return;
+    uint8_t * converted = new uint8_t[StorageSize(l)];
+    for(uint16_t y = 0; y < h; ++y) {
+        if (l == Layout::Tiled) CopyRow(data + y*w*4, converted, w, y, true);
+        else                    CopyRow(converted + y*w*4, data, w, y, false);
+    }
+    delete[] data;
+    data = converted;
+    layout = l;
+    for(uint32_t i = 0; i < mipmaps.size(); ++i) {
+        mipmaps[i]->SetLayout(l);
+    }
+}
+
+// Tiled storage is padded out to whole tiles
+uint32_t Texture::StorageSize(Layout l) const {
+    if (l == Layout::Linear) return w*h*4;
+    return tilesX * ((h + TileSize - 1) / TileSize) * TileSize*TileSize*4;
+}
+
+// Returns row y laid out linearly, copying it into scratch (Width()*4 bytes) if needed
+const uint8_t * Texture::ReadRow(uint16_t y, uint8_t * scratch) const {
+    if (layout == Layout::Linear) return data + y*w*4;
+    CopyRow(scratch, data, w, y, false);
+    return scratch;
+}
+
+
 
 void Texture::SetBlendRule(ColorAddRule ca) {
-    switch(ca) {
-      case ColorAddRule::None:      carule = ColorAdd_None;    break;
-      case ColorAddRule::Alpha:     carule = ColorAdd_Alpha;   break;
-      case ColorAddRule::Additive:  carule = ColorAdd_Additive;break;
-    }
+    carule = GetPixelBlend(ca);
+    spanrule = GetSpanBlend(ca, true);
 }
 
 void Texture::SetSampleRule(SampleRule s) {
-    switch(s) {
-      case SampleRule::Basic:               sarule = SampleRule_Basic; break;
-      case SampleRule::LinearInterpolation: sarule = SampleRule_LI;    break;
-    }
+    sarule = s;
 }
 
 
 
 
 void Texture::PutPixel(uint16_t x, uint16_t y, const uint8_t * src) {
-    memcpy(data+4*(x+y*w), carule(src, data+4*(x+y*w)), 4);   
+    carule(src, data+4*Offset(x, y));   
 }
 
 void Texture::PutPixel(uint16_t x, uint16_t y, const Color * srcC) {
-    static Color32 src;
+    Color32 src;
     src.r = srcC->r*UINT8_MAX;
     src.g = srcC->g*UINT8_MAX;
     src.b = srcC->b*UINT8_MAX;
     src.a = srcC->a*UINT8_MAX;
-    memcpy(data+4*(x+y*w), carule((uint8_t*)&src, data+4*(x+y*w)), 4);
+    carule((uint8_t*)&src, data+4*Offset(x, y));
 }
 
-void Texture::GetPixel(uint16_t x, uint16_t y, uint8_t * src) {
-    memcpy(src, data+4*(x+y*w), 4);
+void Texture::PutSpan(uint16_t x, uint16_t y, uint32_t count, const uint8_t * src, const uint8_t * mask) {
+    if (layout == Layout::Linear) {
+        spanrule(src, data+4*(x+y*w), count, mask);
+        return;
+    }
+
+    // pixels of a row are only consecutive within each tile
+    while(count) {
+        uint32_t n = std::min(count, (uint32_t)(TileSize - x % TileSize));
+        spanrule(src, data+4*Offset(x, y), n, mask);
+        x += n;
+        src += 4*n;
+        if (mask) mask += n;
+        count -= n;
+    }
+}
+
+void Texture::GetPixel(uint16_t x, uint16_t y, uint8_t * src) const {
+    memcpy(src, data+4*Offset(x, y), 4);
 }
 
-void Texture::GetPixel(uint16_t x, uint16_t y, Color * src) {
-    src->r = (*(data+4*(x+y*w+0)))/(float)UINT8_MAX;
-    src->g = (*(data+4*(x+y*w+1)))/(float)UINT8_MAX;
-    src->b = (*(data+4*(x+y*w+2)))/(float)UINT8_MAX;
-    src->a = (*(data+4*(x+y*w+3)))/(float)UINT8_MAX;
+void Texture::GetPixel(uint16_t x, uint16_t y, Color * src) const {
+    const uint8_t * pixel = data+4*Offset(x, y);
+    src->r = pixel[0]/(float)UINT8_MAX;
+    src->g = pixel[1]/(float)UINT8_MAX;
+    src->b = pixel[2]/(float)UINT8_MAX;
+    src->a = pixel[3]/(float)UINT8_MAX;
 }
 
 
 
-void Texture::SamplePixel(float x, float y, uint8_t * src) {
-    GetPixel(
-        std::max(std::min(x, 1.f), 0.f)*w,
-        std::max(std::min(x, 1.f), 0.f)*h,
-        src
-    );
+void Texture::SamplePixel(float x, float y, uint8_t * src) const {
+    Sampler(sarule).Sample(this, x, y, 0.f, src);
 }
 
-void Texture::SamplePixel(float x, float y, Color * src) {
-    GetPixel(
-        std::max(std::min(x, 1.f), 0.f)*w,
-        std::max(std::min(x, 1.f), 0.f)*h,
-        src
-    );
+void Texture::SamplePixel(float x, float y, Color * src) const {
+    SamplePixel(x, y, 0.f, src);
+}
+
+void Texture::SamplePixel(float x, float y, float lod, uint8_t * src) const {
+    Sampler(sarule).Sample(this, x, y, lod, src);
+}
+
+void Texture::SamplePixel(float x, float y, float lod, Color * src) const {
+    uint8_t pixel[4];
+    Sampler(sarule).Sample(this, x, y, lod, pixel);
+    src->r = pixel[0]/(float)UINT8_MAX;
+    src->g = pixel[1]/(float)UINT8_MAX;
+    src->b = pixel[2]/(float)UINT8_MAX;
+    src->a = pixel[3]/(float)UINT8_MAX;
+}
+
+float Texture::GetLod(float dudx, float dvdx, float dudy, float dvdy) const {
+    float alongX = (dudx*w)*(dudx*w) + (dvdx*h)*(dvdx*h);
+    float alongY = (dudy*w)*(dudy*w) + (dvdy*h)*(dvdy*h);
+    return .5f * std::log2(std::max(alongX, alongY));
+}
+
+
+
+// Each level is made from rows of the one before, read linearly
+void Texture::GenerateMipmaps() {
+    ClearMipmaps();
+    DownsampleKernel downsample = GetDownsampleKernel(true);
+    Texture * level = this;
+    while(level->w > 1 || level->h > 1) {
+        Texture * next = new Texture(std::max(level->w / 2, 1), std::max(level->h / 2, 1));
+        std::vector<uint8_t> scratch(level->w*4*2);
+        std::vector<uint8_t> narrow(4*2*2);
+        for(uint16_t y = 0; y < next->h; ++y) {
+            const uint8_t * row0 = level->ReadRow(std::min(y*2,   level->h-1), &scratch[0]);
+            const uint8_t * row1 = level->ReadRow(std::min(y*2+1, level->h-1), &scratch[level->w*4]);
+
+            // a single column pairs with itself
+            if (level->w == 1) {
+                memcpy(&narrow[0], row0, 4); memcpy(&narrow[4],  row0, 4);
+                memcpy(&narrow[8], row1, 4); memcpy(&narrow[12], row1, 4);
+                row0 = &narrow[0];
+                row1 = &narrow[8];
+            }
+            downsample(row0, row1, next->data + y*next->w*4, next->w);
+        }
+        next->SetLayout(layout);
+        mipmaps.push_back(next);
+        level = next;
+    }
+}
+
+void Texture::SetMipmap(uint32_t level, const uint8_t * pixels) {
+    Texture * parent = level ? GetMipmap(level-1) : nullptr;
+    if (!parent || (parent->w == 1 && parent->h == 1)) return;
+
+    Texture * next = new Texture(std::max(parent->w / 2, 1), std::max(parent->h / 2, 1), (uint8_t*)pixels);
+    next->SetLayout(layout);
+    if (level <= mipmaps.size()) {
+        delete mipmaps[level-1];
+        mipmaps[level-1] = next;
+    } else {
+        mipmaps.push_back(next);
+    }
+}
+
+void Texture::ClearMipmaps() {
+    for(uint32_t i = 0; i < mipmaps.size(); ++i) {
+        delete mipmaps[i];
+    }
+    mipmaps.clear();
 }
 
 
@@ -148,44 +269,40 @@ void Texture::SamplePixel(float x, float y, Color * src) {
 
 
 void Texture::PutTexture(uint16_t x_, uint16_t y_, uint16_t maxX, uint16_t maxY, Texture * t) {
-    uint16_t srcX = 0;
-    uint16_t srcY = 0;
-    for(uint16_t y = y_; y < maxY && srcY < t->h; ++y, ++srcY) {
-        for(uint16_t x = x_; x < maxX && srcX < t->w; ++x, ++srcX) {
-            if (x < 0 || x >= w ||
-                y < 0 || y >= h
-                ) continue;
-
-            PutPixel(x, y, t->GetData()+4*(srcX + srcY*t->w));
-        }
+    // each source row that lands on the destination is blended as one span
+    uint32_t xEnd = std::min(std::min((uint32_t)maxX, (uint32_t)w), x_ + (uint32_t)t->w);
+    uint32_t yEnd = std::min(std::min((uint32_t)maxY, (uint32_t)h), y_ + (uint32_t)t->h);
+    if (x_ >= xEnd) return;
+    std::vector<uint8_t> scratch(t->w*4);
+    for(uint32_t y = y_; y < yEnd; ++y) {
+        PutSpan(x_, y, xEnd - x_, t->ReadRow(y - y_, &scratch[0]), nullptr);
     }
 }
 
+// Works a row at a time, so that tiled rows are only gathered once
 void Texture::GetAsFormat(Format fmt, uint8_t * out) {
-    if (fmt == Format::RGB) {
-        for(uint16_t y = 0; y < h; ++y) {
+    std::vector<uint8_t> scratch(w*4);
+    for(uint16_t y = 0; y < h; ++y) {
+        const uint8_t * row = ReadRow(y, &scratch[0]);
+        if (fmt == Format::RGB) {
             for(uint16_t x = 0; x < w; ++x) {
-                *(out+(x+y*w)*3+0) = *(data+(x+y*w)*4+0);
-                *(out+(x+y*w)*3+1) = *(data+(x+y*w)*4+1);
-                *(out+(x+y*w)*3+2) = *(data+(x+y*w)*4+2);
+                *(out+(x+y*w)*3+0) = row[x*4+0];
+                *(out+(x+y*w)*3+1) = row[x*4+1];
+                *(out+(x+y*w)*3+2) = row[x*4+2];
             }
-        }
-    } else if (fmt == Format::BlendedRGB) {
-        float alpha;
-        for(uint16_t y = 0; y < h; ++y) {
+        } else if (fmt == Format::BlendedRGB) {
+            float alpha;
             for(uint16_t x = 0; x < w; ++x) {
-                alpha = *(data+(x+y*w)*4+3);
-                *(out+(x+y*w)*3+0) = *(data+(x+y*w)*4+0) * alpha;
-                *(out+(x+y*w)*3+1) = *(data+(x+y*w)*4+1) * alpha;
-                *(out+(x+y*w)*3+2) = *(data+(x+y*w)*4+2) * alpha;
+                alpha = row[x*4+3];
+                *(out+(x+y*w)*3+0) = row[x*4+0] * alpha;
+                *(out+(x+y*w)*3+1) = row[x*4+1] * alpha;
+                *(out+(x+y*w)*3+2) = row[x*4+2] * alpha;
             }
-        }
-    } else {
-        float val;
-        for(uint16_t y = 0; y < h; ++y) {
+        } else {
+            float val;
             for(uint16_t x = 0; x < w; ++x) {
-                val = *(data+(x+y*w)*4+0) + *(data+(x+y*w)*4+1) + 
-                      *(data+(x+y*w)*4+2) + *(data+(x+y*w)*4+3);
+                val = row[x*4+0] + row[x*4+1] + 
+                      row[x*4+2] + row[x*4+3];
                 *(out+(x+y*w)) = UINT8_MAX*(val / 4.f);
             }
         }
@@ -195,7 +312,7 @@ void Texture::GetAsFormat(Format fmt, uint8_t * out) {
 
 void Texture::Clear(uint8_t * src) {
     uint32_t clr = *((uint32_t*)src);
-    memset(data, clr, w*h*4);
+    memset(data, clr, StorageSize(layout));
 }
 
 
@@ -204,55 +321,21 @@ void Texture::Clear(uint8_t * src) {
 
 
 //////////// statics
-uint8_t * ColorAdd_None(const uint8_t * src, const uint8_t * dest) {
-    static Color32 out;
-    out = *((Color32*)src);
-    return (uint8_t *)&out;
-}
-
-
-uint8_t * ColorAdd_Alpha(const uint8_t * src, const uint8_t * dest) {
-    static Color32 out;
-    static float alpha;
-    alpha = (src[3] / (float)UINT8_MAX);
-    out.r = dest[0]*(1-alpha) + src[0]*alpha;
-    out.g = dest[1]*(1-alpha) + src[1]*alpha;
-    out.b = dest[2]*(1-alpha) + src[2]*alpha;
-    out.a = dest[3]*(1-alpha) + src[3]*alpha;
-    
-
-    return (uint8_t *)&out;
-}
-
-uint8_t * ColorAdd_Additive(const uint8_t * src, const uint8_t * dest) {
-    static Color32 out;
-    out.r = src[0] + dest[0];
-    out.g = src[1] + dest[1];
-    out.b = src[2] + dest[2];
-    out.a = src[3] + dest[3];    
-    return (uint8_t *)&out;
-}
-
-
-
-uint8_t * SampleRule_Basic(uint16_t x, uint16_t y, Texture * t) {
-    static Color32 out;
-    out.r = *(t->GetData() + (x+(y*t->Width()))*4);
-    out.g = *(t->GetData() + (x+(y*t->Width())+1)*4);
-    out.b = *(t->GetData() + (x+(y*t->Width())+2)*4);
-    out.a = *(t->GetData() + (x+(y*t->Width())+3)*4);
-    return (uint8_t *)&out;
-}
-
-
-//TODO
-uint8_t * SampleRule_LI(uint16_t x, uint16_t y, Texture * t) {
-    static Color32 out;
-    out.r = *(t->GetData() + (x+(y*t->Width()))*4);
-    out.g = *(t->GetData() + (x+(y*t->Width())+1)*4);
-    out.b = *(t->GetData() + (x+(y*t->Width())+2)*4);
-    out.a = *(t->GetData() + (x+(y*t->Width())+3)*4);
-    return (uint8_t *)&out;
+// Color rules (see BlendKernels.h) blend in place and may be
+// called from multiple threads at once, so they keep no shared state.
+
+// Copies row y between linear pixels and tiled storage, in the direction given
+void CopyRow(uint8_t * linearRow, uint8_t * tiled, uint16_t w, uint16_t y, bool toTiled) {
+    const uint32_t size = Texture::TileSize;
+    uint32_t tilesX = (w + size - 1) / size;
+    uint8_t * tileRow = tiled + ((y / size)*tilesX*size*size + (y % size)*size)*4;
+    for(uint32_t tx = 0; tx < tilesX; ++tx) {
+        uint8_t * linear = linearRow + tx*size*4;
+        uint8_t * block = tileRow + tx*size*size*4;
+        uint32_t n = std::min(size, w - tx*size);
+        if (toTiled) memcpy(block, linear, n*4);
+        else         memcpy(linear, block, n*4);
+    }
 }
 
 
@@ -0,0 +1,329 @@
+#include "TextureKernels.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// Like the raster kernels, the vector kernels are compiled for their
+// instruction sets on a per-function basis and only used if the CPU reports support.
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+    #define SR_TEXTURE_KERNELS_X86
+    #include <immintrin.h>
+#endif
+
+using namespace SoftRaster;
+
+
+static void Downsample_Scalar(const uint8_t *, const uint8_t *, uint8_t *, uint32_t);
+#ifdef SR_TEXTURE_KERNELS_X86
+static void Downsample_SSE2(const uint8_t *, const uint8_t *, uint8_t *, uint32_t);
+#endif
+
+static void Sample_Scalar(const SampleParams &, const float *, const float *, uint32_t, uint8_t *);
+#ifdef SR_TEXTURE_KERNELS_X86
+static void Sample_AVX2(const SampleParams &, const float *, const float *, uint32_t, uint8_t *);
+#endif
+
+
+// Texel positions are limited to this far out before becoming integers,
+// which keeps the conversion defined for any input.
+static const float max_position = 1 << 24;
+
+
+struct TextureKernelChoice {
+    TextureKernelChoice() {
+        downsample = Downsample_Scalar;
+        sample = Sample_Scalar;
+      #ifdef SR_TEXTURE_KERNELS_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("sse2")) {
+            downsample = Downsample_SSE2;
+        }
+        if (__builtin_cpu_supports("avx2")) {
+            sample = Sample_AVX2;
+        }
+      #endif
+    }
+
+    DownsampleKernel downsample;
+    SampleKernel sample;
+};
+
+static const TextureKernelChoice & GetChoice() {
+    static TextureKernelChoice choice;
+    return choice;
+}
+
+DownsampleKernel SoftRaster::GetDownsampleKernel(bool vectorized) {
+    return vectorized ? GetChoice().downsample : Downsample_Scalar;
+}
+
+SampleKernel SoftRaster::GetSampleKernel(bool vectorized) {
+    return vectorized ? GetChoice().sample : Sample_Scalar;
+}
+
+
+
+
+///// Statics//////
+void Downsample_Scalar(const uint8_t * row0, const uint8_t * row1, uint8_t * out, uint32_t count) {
+    for(uint32_t i = 0; i < count*4; ++i) {
+        uint32_t c = i % 4;
+        uint32_t left = (i - c)*2 + c;
+        out[i] = (row0[left] + row0[left+4] + row1[left] + row1[left+4] + 2) >> 2;
+    }
+}
+
+
+// NaN is treated as the lowest position
+static inline float Limit(float position) {
+    if (!(position > -max_position)) return -max_position;
+    return std::min(position, max_position);
+}
+
+// Returns i modulo size, from 0 to size-1, masking if size is a power of 2
+static inline int32_t Modulo(int32_t i, int32_t size) {
+    if (!(size & (size - 1))) return i & (size - 1);
+    i %= size;
+    return i < 0 ? i + size : i;
+}
+
+// Returns the texel index to read for index i along an axis of size texels
+static inline int32_t WrapIndex(int32_t i, int32_t size, Sampler::Wrap wrap) {
+    switch(wrap) {
+      case Sampler::Wrap::Clamp:  return std::max(std::min(i, size - 1), 0);
+      case Sampler::Wrap::Repeat: return Modulo(i, size);
+      default: {
+        int32_t period = size*2;
+        i = Modulo(i, period);
+        return i < size ? i : period - 1 - i;
+      }
+    }
+}
+
+static inline uint32_t Fetch(const SampleLevel & level, uint32_t x, uint32_t y) {
+    const uint32_t size = Texture::TileSize;
+    uint32_t offset = !level.tilesX ? x + y*level.w :
+        ((y / size)*level.tilesX + x / size)*size*size + (y % size)*size + x % size;
+    uint32_t pixel;
+    memcpy(&pixel, level.data + offset*4, 4);
+    return pixel;
+}
+
+// Blends the 4 texels around the position
+static void Bilinear(const SampleLevel & level, const SampleParams & params, float u, float v, float out[4]) {
+    float fx = Limit(u * level.w - .5f);
+    float fy = Limit(v * level.h - .5f);
+    float x0f = std::floor(fx);
+    float y0f = std::floor(fy);
+    float tx = fx - x0f;
+    float ty = fy - y0f;
+    int32_t x0 = WrapIndex((int32_t)x0f,     level.w, params.wrapU);
+    int32_t x1 = WrapIndex((int32_t)x0f + 1, level.w, params.wrapU);
+    int32_t y0 = WrapIndex((int32_t)y0f,     level.h, params.wrapV);
+    int32_t y1 = WrapIndex((int32_t)y0f + 1, level.h, params.wrapV);
+
+    uint32_t p[4] = {
+        Fetch(level, x0, y0), Fetch(level, x1, y0),
+        Fetch(level, x0, y1), Fetch(level, x1, y1)
+    };
+    for(int c = 0; c < 4; ++c) {
+        int32_t p0 = (p[0] >> 8*c) & 0xff, p1 = (p[1] >> 8*c) & 0xff;
+        int32_t p2 = (p[2] >> 8*c) & 0xff, p3 = (p[3] >> 8*c) & 0xff;
+        float top    = p0 + (p1 - p0) * tx;
+        float bottom = p2 + (p3 - p2) * tx;
+        out[c] = top + (bottom - top) * ty;
+    }
+}
+
+void Sample_Scalar(const SampleParams & params, const float * u, const float * v, uint32_t count, uint8_t * out) {
+    const SampleLevel & level = params.levels[0];
+    for(uint32_t i = 0; i < count; ++i, out += 4) {
+        if (!params.bilinear) {
+            int32_t x = WrapIndex((int32_t)std::floor(Limit(u[i] * level.w)), level.w, params.wrapU);
+            int32_t y = WrapIndex((int32_t)std::floor(Limit(v[i] * level.h)), level.h, params.wrapV);
+            uint32_t pixel = Fetch(level, x, y);
+            memcpy(out, &pixel, 4);
+            continue;
+        }
+
+        float sample[4];
+        Bilinear(level, params, u[i], v[i], sample);
+        if (params.blend > 0.f) {
+            float next[4];
+            Bilinear(params.levels[1], params, u[i], v[i], next);
+            for(int c = 0; c < 4; ++c) sample[c] += (next[c] - sample[c]) * params.blend;
+        }
+        for(int c = 0; c < 4; ++c) out[c] = (uint8_t)(sample[c] + .5f);
+    }
+}
+
+
+
+
+#ifdef SR_TEXTURE_KERNELS_X86
+
+// Sums the 2x2 blocks of 4 pixels from each row into 2 pixels of 16-bit channels
+__attribute__((target("sse2")))
+static inline __m128i BlockSums_SSE2(__m128i top, __m128i bottom) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(top, zero), _mm_unpacklo_epi8(bottom, zero));
+    __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(top, zero), _mm_unpackhi_epi8(bottom, zero));
+    return _mm_add_epi16(_mm_unpacklo_epi64(lo, hi), _mm_unpackhi_epi64(lo, hi));
+}
+
+__attribute__((target("sse2")))
+void Downsample_SSE2(const uint8_t * row0, const uint8_t * row1, uint8_t * out, uint32_t count) {
+    const __m128i round = _mm_set1_epi16(2);
+    uint32_t i = 0;
+    for(; i + 4 <= count; i += 4) {
+        __m128i a = BlockSums_SSE2(
+            _mm_loadu_si128((const __m128i*)(row0 + 8*i)),
+            _mm_loadu_si128((const __m128i*)(row1 + 8*i)));
+        __m128i b = BlockSums_SSE2(
+            _mm_loadu_si128((const __m128i*)(row0 + 8*i + 16)),
+            _mm_loadu_si128((const __m128i*)(row1 + 8*i + 16)));
+        a = _mm_srli_epi16(_mm_add_epi16(a, round), 2);
+        b = _mm_srli_epi16(_mm_add_epi16(b, round), 2);
+        _mm_storeu_si128((__m128i*)(out + 4*i), _mm_packus_epi16(a, b));
+    }
+    Downsample_Scalar(row0 + 8*i, row1 + 8*i, out + 4*i, count - i);
+}
+
+
+
+// 8 sample positions along one axis of a level, as texel indices
+// before wrapping and, for bilinear samples, the weight of the next texel
+struct Axis_AVX2 {
+    __m256i index;
+    __m256  weight;
+};
+
+__attribute__((target("avx2")))
+static inline __m256 Limit_AVX2(__m256 position) {
+    // max returns its second operand for NaN, like Limit()
+    position = _mm256_max_ps(position, _mm256_set1_ps(-max_position));
+    return _mm256_min_ps(position, _mm256_set1_ps(max_position));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i Modulo_AVX2(__m256i i, int32_t size) {
+    if (!(size & (size - 1))) return _mm256_and_si256(i, _mm256_set1_epi32(size - 1));
+
+    // the float quotient may be off by one either way, which is corrected after
+    __m256 q = _mm256_floor_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(i), _mm256_set1_ps(1.f / size)));
+    const __m256i vsize = _mm256_set1_epi32(size);
+    __m256i r = _mm256_sub_epi32(i, _mm256_mullo_epi32(_mm256_cvttps_epi32(q), vsize));
+    r = _mm256_add_epi32(r, _mm256_and_si256(_mm256_cmpgt_epi32(_mm256_setzero_si256(), r), vsize));
+    r = _mm256_sub_epi32(r, _mm256_andnot_si256(_mm256_cmpgt_epi32(vsize, r), vsize));
+    return r;
+}
+
+__attribute__((target("avx2")))
+static inline __m256i WrapIndex_AVX2(__m256i i, int32_t size, Sampler::Wrap wrap) {
+    switch(wrap) {
+      case Sampler::Wrap::Clamp:
+        return _mm256_max_epi32(_mm256_min_epi32(i, _mm256_set1_epi32(size - 1)), _mm256_setzero_si256());
+      case Sampler::Wrap::Repeat:
+        return Modulo_AVX2(i, size);
+      default: {
+        i = Modulo_AVX2(i, size*2);
+        __m256i flipped = _mm256_sub_epi32(_mm256_set1_epi32(size*2 - 1), i);
+        return _mm256_blendv_epi8(flipped, i, _mm256_cmpgt_epi32(_mm256_set1_epi32(size), i));
+      }
+    }
+}
+
+__attribute__((target("avx2")))
+static inline __m256i Fetch_AVX2(const SampleLevel & level, __m256i x, __m256i y) {
+    static_assert(Texture::TileSize == 4, "tiled offsets are computed with shifts");
+    __m256i offset;
+    if (!level.tilesX) {
+        offset = _mm256_add_epi32(x, _mm256_mullo_epi32(y, _mm256_set1_epi32(level.w)));
+    } else {
+        const __m256i within = _mm256_set1_epi32(Texture::TileSize - 1);
+        __m256i tile = _mm256_add_epi32(
+            _mm256_mullo_epi32(_mm256_srli_epi32(y, 2), _mm256_set1_epi32(level.tilesX)),
+            _mm256_srli_epi32(x, 2));
+        offset = _mm256_add_epi32(
+            _mm256_slli_epi32(tile, 4),
+            _mm256_add_epi32(_mm256_slli_epi32(_mm256_and_si256(y, within), 2), _mm256_and_si256(x, within)));
+    }
+    return _mm256_i32gather_epi32((const int *)level.data, offset, 4);
+}
+
+// Returns channel c of 8 pixels
+__attribute__((target("avx2")))
+static inline __m256i Channel_AVX2(__m256i pixels, int c) {
+    return _mm256_and_si256(_mm256_srlv_epi32(pixels, _mm256_set1_epi32(8*c)), _mm256_set1_epi32(0xff));
+}
+
+__attribute__((target("avx2")))
+static inline __m256 Lerp_AVX2(__m256i a, __m256i b, __m256 t) {
+    __m256 diff = _mm256_cvtepi32_ps(_mm256_sub_epi32(b, a));
+    return _mm256_add_ps(_mm256_cvtepi32_ps(a), _mm256_mul_ps(diff, t));
+}
+
+// Like Bilinear(), for 8 positions, writing each channel to out
+__attribute__((target("avx2")))
+static inline void Bilinear_AVX2(const SampleLevel & level, const SampleParams & params, __m256 u, __m256 v, __m256 out[4]) {
+    __m256 fx = Limit_AVX2(_mm256_sub_ps(_mm256_mul_ps(u, _mm256_set1_ps(level.w)), _mm256_set1_ps(.5f)));
+    __m256 fy = Limit_AVX2(_mm256_sub_ps(_mm256_mul_ps(v, _mm256_set1_ps(level.h)), _mm256_set1_ps(.5f)));
+    __m256 x0f = _mm256_floor_ps(fx);
+    __m256 y0f = _mm256_floor_ps(fy);
+    __m256 tx = _mm256_sub_ps(fx, x0f);
+    __m256 ty = _mm256_sub_ps(fy, y0f);
+    const __m256i one = _mm256_set1_epi32(1);
+    __m256i x0 = _mm256_cvttps_epi32(x0f);
+    __m256i y0 = _mm256_cvttps_epi32(y0f);
+    __m256i x1 = WrapIndex_AVX2(_mm256_add_epi32(x0, one), level.w, params.wrapU);
+    __m256i y1 = WrapIndex_AVX2(_mm256_add_epi32(y0, one), level.h, params.wrapV);
+    x0 = WrapIndex_AVX2(x0, level.w, params.wrapU);
+    y0 = WrapIndex_AVX2(y0, level.h, params.wrapV);
+
+    __m256i p0 = Fetch_AVX2(level, x0, y0);
+    __m256i p1 = Fetch_AVX2(level, x1, y0);
+    __m256i p2 = Fetch_AVX2(level, x0, y1);
+    __m256i p3 = Fetch_AVX2(level, x1, y1);
+    for(int c = 0; c < 4; ++c) {
+        __m256 top    = Lerp_AVX2(Channel_AVX2(p0, c), Channel_AVX2(p1, c), tx);
+        __m256 bottom = Lerp_AVX2(Channel_AVX2(p2, c), Channel_AVX2(p3, c), tx);
+        out[c] = _mm256_add_ps(top, _mm256_mul_ps(_mm256_sub_ps(bottom, top), ty));
+    }
+}
+
+__attribute__((target("avx2")))
+void Sample_AVX2(const SampleParams & params, const float * u, const float * v, uint32_t count, uint8_t * out) {
+    const SampleLevel & level = params.levels[0];
+    uint32_t i = 0;
+    for(; i + 8 <= count; i += 8) {
+        __m256 vu = _mm256_loadu_ps(u + i);
+        __m256 vv = _mm256_loadu_ps(v + i);
+        __m256i pixels;
+        if (!params.bilinear) {
+            __m256i x = _mm256_cvttps_epi32(_mm256_floor_ps(Limit_AVX2(_mm256_mul_ps(vu, _mm256_set1_ps(level.w)))));
+            __m256i y = _mm256_cvttps_epi32(_mm256_floor_ps(Limit_AVX2(_mm256_mul_ps(vv, _mm256_set1_ps(level.h)))));
+            pixels = Fetch_AVX2(level, WrapIndex_AVX2(x, level.w, params.wrapU), WrapIndex_AVX2(y, level.h, params.wrapV));
+        } else {
+            __m256 sample[4];
+            Bilinear_AVX2(level, params, vu, vv, sample);
+            if (params.blend > 0.f) {
+                __m256 next[4];
+                const __m256 blend = _mm256_set1_ps(params.blend);
+                Bilinear_AVX2(params.levels[1], params, vu, vv, next);
+                for(int c = 0; c < 4; ++c)
+                    sample[c] = _mm256_add_ps(sample[c], _mm256_mul_ps(_mm256_sub_ps(next[c], sample[c]), blend));
+            }
+            pixels = _mm256_setzero_si256();
+            for(int c = 0; c < 4; ++c) {
+                __m256i channel = _mm256_cvttps_epi32(_mm256_add_ps(sample[c], _mm256_set1_ps(.5f)));
+                pixels = _mm256_or_si256(pixels, _mm256_slli_epi32(channel, 8*c));
+            }
+        }
+        _mm256_storeu_si256((__m256i*)(out + 4*i), pixels);
+    }
+    // not inserted by the compiler here, and SSE code after is slowed without it
+    _mm256_zeroupper();
+    Sample_Scalar(params, u + i, v + i, count - i, out + 4*i);
+}
+
+#endif
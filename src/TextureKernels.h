@@ -0,0 +1,55 @@
+#ifndef H_SOFTRASTER_TEXTURE_KERNELS_INCLUDED
+#define H_SOFTRASTER_TEXTURE_KERNELS_INCLUDED
+
+/* SoftRaster: TextureKernels (internal)
+   Johnathan Corkery, 2015 */
+#include <cstdint>
+#include <SoftRaster/Sampler.h>
+
+namespace SoftRaster {
+
+// Averages each 2x2 block of pixels from two rows into one pixel, for count
+// pixels out. row0 and row1 each hold 2*count pixels. Channels are
+// averaged separately and rounded to nearest, with halves rounding up.
+//
+// Every kernel gives the same results as the scalar one, bit for bit.
+typedef void (*DownsampleKernel)(const uint8_t * row0, const uint8_t * row1, uint8_t * out, uint32_t count);
+
+
+// Returns the widest kernel supported by the running CPU,
+// or the scalar kernel if not vectorized.
+DownsampleKernel GetDownsampleKernel(bool vectorized);
+
+
+
+// One mipmap level as the sample kernels read it. Pixels are
+// stored as Texture stores them, tiled or not.
+struct SampleLevel {
+    const uint8_t * data;
+    int32_t w, h;
+    int32_t tilesX; // 0 if linear
+};
+
+// Everything that stays the same across a batch of samples.
+// If blend is nonzero, bilinear samples of both levels are blended
+// by it (trilinear). Otherwise only the first level is read.
+struct SampleParams {
+    SampleLevel levels[2];
+    float blend;
+    bool bilinear;
+    Sampler::Wrap wrapU, wrapV;
+};
+
+// Samples count normalized positions (u[i], v[i]), writing 4-byte pixels to out.
+//
+// Every kernel gives the same results as the scalar one, bit for bit.
+typedef void (*SampleKernel)(const SampleParams &, const float * u, const float * v, uint32_t count, uint8_t * out);
+
+
+// Returns the widest kernel supported by the running CPU,
+// or the scalar kernel if not vectorized.
+SampleKernel GetSampleKernel(bool vectorized);
+
+}
+
+#endif
@@ -0,0 +1,70 @@
+#include "WorkerPool.h"
+
+using namespace SoftRaster;
+
+WorkerPool::WorkerPool(uint32_t numWorkers) :
+    task      (nullptr),
+    taskCount (0),
+    nextTask  (0),
+    busy      (0),
+    generation(0),
+    quit      (false) {
+
+    for(uint32_t i = 1; i < numWorkers; ++i) {
+        threads.push_back(std::thread(&WorkerPool::ThreadMain, this, i));
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        quit = true;
+    }
+    wake.notify_all();
+    for(uint32_t i = 0; i < threads.size(); ++i) {
+        threads[i].join();
+    }
+}
+
+void WorkerPool::Run(uint32_t count, const Task & t) {
+    if (!count) return;
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        task      = &t;
+        taskCount = count;
+        nextTask  = 0;
+        busy      = threads.size();
+        generation++;
+    }
+    wake.notify_all();
+
+    Work(0);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [this]{ return busy == 0; });
+    task = nullptr;
+}
+
+void WorkerPool::Work(uint32_t worker) {
+    uint32_t i;
+    while((i = nextTask++) < taskCount) {
+        (*task)(worker, i);
+    }
+}
+
+void WorkerPool::ThreadMain(uint32_t worker) {
+    uint64_t seen = 0;
+    for(;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&]{ return quit || generation != seen; });
+            if (quit) return;
+            seen = generation;
+        }
+
+        Work(worker);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        if (--busy == 0) done.notify_one();
+    }
+}
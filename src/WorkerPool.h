@@ -0,0 +1,52 @@
+#ifndef H_SOFTRASTER_WORKER_POOL_INCLUDED
+#define H_SOFTRASTER_WORKER_POOL_INCLUDED
+
+/* SoftRaster: WorkerPool (internal)
+   Johnathan Corkery, 2015 */
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace SoftRaster {
+
+// A fixed set of threads that run batches of indexed tasks.
+//
+// The thread calling Run() always takes part as worker 0,
+// so a pool of N workers only spawns N-1 threads.
+class WorkerPool {
+  public:
+    // worker index, task index
+    typedef std::function<void(uint32_t, uint32_t)> Task;
+
+    WorkerPool(uint32_t numWorkers);
+    ~WorkerPool();
+
+    // Runs task(worker, i) for each i in [0, count) and returns once all have finished.
+    // Tasks are handed out in order to whichever worker is free.
+    void Run(uint32_t count, const Task & task);
+
+    uint32_t GetWorkerCount() const { return threads.size()+1; }
+
+  private:
+    void Work(uint32_t worker);
+    void ThreadMain(uint32_t worker);
+
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+
+    const Task * task;
+    uint32_t taskCount;
+    std::atomic<uint32_t> nextTask;
+    uint32_t busy;
+    uint64_t generation;
+    bool quit;
+};
+
+}
+#endif